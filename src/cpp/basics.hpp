@@ -71,6 +71,18 @@ namespace veritas {
             };
         }
 
+        /** Select the rows [begin, end) from the data. */
+        inline data rows(size_t begin, size_t end) const
+        {
+            return {
+                ptr+index(begin, 0),
+                end-begin,
+                num_cols,
+                stride_row,
+                stride_col,
+            };
+        }
+
         data(std::vector<FloatT>& v)
             : ptr(&v[0])
             , num_rows(1), num_cols(v.size())
@@ -0,0 +1,396 @@
+/**
+ * \file binary.cpp
+ *
+ * Versioned binary model format. Layout (all offsets from the file start):
+ *
+ *   Header                    48 bytes
+ *   uint64 tree_offset[n+1]   node index of the root of each tree
+ *   (pad to 16)  Node nodes[num_nodes]
+ *   (pad to 16)  NodeId parents[num_nodes]
+ *
+ * Everything is written in the byte order of the writer. The `endian` field
+ * holds ENDIAN_TAG, so a reader detects the other byte order and converts.
+ *
+ * The same format is used for POSIX shared memory segments, see
+ * AddTree::to_shared_memory.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "tree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace veritas {
+
+    namespace inner {
+
+        const char BINARY_MAGIC[8] = {'V', 'E', 'R', 'I', 'T', 'A', 'S', 'B'};
+        const uint32_t BINARY_VERSION = 1;
+        const uint32_t ENDIAN_TAG = 0x01020304;
+
+        struct BinaryHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t endian;
+            uint32_t float_size;
+            uint32_t node_size;
+            uint64_t num_trees;
+            uint64_t num_nodes;
+            FloatT base_score;
+            uint32_t reserved;
+        };
+
+        static_assert(sizeof(BinaryHeader) == 48, "binary header layout");
+        static_assert(sizeof(FloatT) == 4 && sizeof(FeatId) == 4 && sizeof(NodeId) == 4,
+                "binary format assumes 32-bit fields");
+
+        static inline size_t align16(size_t n) { return (n + 15) & ~size_t(15); }
+
+        struct BinaryLayout {
+            size_t tree_offset_pos, nodes_pos, parents_pos, size;
+
+            BinaryLayout(uint64_t num_trees, uint64_t num_nodes)
+            {
+                tree_offset_pos = sizeof(BinaryHeader);
+                nodes_pos = align16(tree_offset_pos + (num_trees + 1) * sizeof(uint64_t));
+                parents_pos = align16(nodes_pos + num_nodes * sizeof(Node));
+                size = parents_pos + num_nodes * sizeof(NodeId);
+            }
+        };
+
+        template <typename T>
+        static T byteswap(T v)
+        {
+            char *p = reinterpret_cast<char *>(&v);
+            std::reverse(p, p + sizeof(T));
+            return v;
+        }
+
+        /** Read the header, convert it to native byte order. Returns whether
+         * the buffer is in the other byte order. */
+        static bool
+        read_header(const char *buf, size_t size, BinaryHeader& h)
+        {
+            if (size < sizeof(BinaryHeader))
+                throw std::runtime_error("binary model: truncated header");
+            std::memcpy(&h, buf, sizeof(BinaryHeader));
+            if (std::memcmp(h.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+                throw std::runtime_error("binary model: invalid magic");
+
+            bool swap = h.endian != ENDIAN_TAG;
+            if (swap)
+            {
+                if (byteswap(h.endian) != ENDIAN_TAG)
+                    throw std::runtime_error("binary model: invalid endian tag");
+                h.version = byteswap(h.version);
+                h.float_size = byteswap(h.float_size);
+                h.node_size = byteswap(h.node_size);
+                h.num_trees = byteswap(h.num_trees);
+                h.num_nodes = byteswap(h.num_nodes);
+                h.base_score = byteswap(h.base_score);
+            }
+
+            if (h.version != BINARY_VERSION)
+                throw std::runtime_error("binary model: unsupported version");
+            if (h.float_size != sizeof(FloatT) || h.node_size != sizeof(Node))
+                throw std::runtime_error("binary model: incompatible field sizes");
+            if (h.num_nodes > size || h.num_trees > size
+                    || BinaryLayout(h.num_trees, h.num_nodes).size > size)
+                throw std::runtime_error("binary model: truncated");
+            return swap;
+        }
+
+        /** Check the tree table and the node references of a tree so that
+         * traversing a view never reads out of bounds. */
+        static void
+        validate_tree(const Node *nodes, const NodeId *parents, size_t size)
+        {
+            if (size == 0 || parents[0] != 0)
+                throw std::runtime_error("binary model: invalid root");
+            for (size_t i = 0; i < size; ++i)
+            {
+                const Node& n = nodes[i];
+                if (n.feat_id < -1)
+                    throw std::runtime_error("binary model: invalid feature id");
+                if (!n.is_leaf() && (n.left <= static_cast<NodeId>(i)
+                            || static_cast<size_t>(n.left) + 1 >= size))
+                    throw std::runtime_error("binary model: invalid child");
+                if (i > 0 && (parents[i] < 0 || static_cast<size_t>(parents[i]) >= i))
+                    throw std::runtime_error("binary model: invalid parent");
+            }
+        }
+
+    } // namespace inner
+
+    void
+    AddTree::to_binary(std::ostream& s) const
+    {
+        uint64_t total = num_nodes();
+        inner::BinaryLayout layout(size(), total);
+
+        inner::BinaryHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, inner::BINARY_MAGIC, sizeof(h.magic));
+        h.version = inner::BINARY_VERSION;
+        h.endian = inner::ENDIAN_TAG;
+        h.float_size = sizeof(FloatT);
+        h.node_size = sizeof(inner::Node);
+        h.num_trees = size();
+        h.num_nodes = total;
+        h.base_score = base_score;
+
+        std::vector<uint64_t> offsets;
+        offsets.reserve(size() + 1);
+        uint64_t offset = 0;
+        for (const Tree& t : trees_)
+        {
+            offsets.push_back(offset);
+            offset += t.num_nodes();
+        }
+        offsets.push_back(offset);
+
+        auto pad = [&s](size_t from, size_t to) {
+            for (; from < to; ++from) s.put('\0');
+        };
+
+        s.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        s.write(reinterpret_cast<const char *>(offsets.data()),
+                offsets.size() * sizeof(uint64_t));
+        pad(layout.tree_offset_pos + offsets.size() * sizeof(uint64_t), layout.nodes_pos);
+        for (const Tree& t : trees_)
+        {
+            if (t.has_leaf_transform()) // write the transformed leaf values
+            {
+                Tree copy(t);
+                copy.make_mutable_();
+                s.write(reinterpret_cast<const char *>(copy.node_ptr_),
+                        copy.num_nodes() * sizeof(inner::Node));
+            }
+            else
+                s.write(reinterpret_cast<const char *>(t.node_ptr_),
+                        t.num_nodes() * sizeof(inner::Node));
+        }
+        pad(layout.nodes_pos + total * sizeof(inner::Node), layout.parents_pos);
+        for (const Tree& t : trees_)
+            s.write(reinterpret_cast<const char *>(t.parent_ptr_),
+                    t.num_nodes() * sizeof(NodeId));
+
+        if (!s)
+            throw std::runtime_error("binary model: write failed");
+    }
+
+    void
+    AddTree::to_binary(const std::string& path) const
+    {
+        std::ofstream f(path, std::ios::binary);
+        if (!f)
+            throw std::runtime_error("cannot open " + path);
+        to_binary(f);
+    }
+
+    void
+    AddTree::from_binary(std::istream& s)
+    {
+        std::vector<char> buf;
+        char chunk[1 << 16];
+        while (s.read(chunk, sizeof(chunk)) || s.gcount() > 0)
+            buf.insert(buf.end(), chunk, chunk + s.gcount());
+
+        inner::BinaryHeader h;
+        bool swap = inner::read_header(buf.data(), buf.size(), h);
+        inner::BinaryLayout layout(h.num_trees, h.num_nodes);
+
+        std::vector<uint64_t> offsets(h.num_trees + 1);
+        std::memcpy(offsets.data(), buf.data() + layout.tree_offset_pos,
+                offsets.size() * sizeof(uint64_t));
+        std::vector<inner::Node> nodes(h.num_nodes);
+        std::memcpy(static_cast<void *>(nodes.data()), buf.data() + layout.nodes_pos,
+                nodes.size() * sizeof(inner::Node));
+        std::vector<NodeId> parents(h.num_nodes);
+        std::memcpy(parents.data(), buf.data() + layout.parents_pos,
+                parents.size() * sizeof(NodeId));
+
+        if (swap)
+        {
+            for (uint64_t& o : offsets) o = inner::byteswap(o);
+            for (inner::Node& n : nodes)
+            {
+                n.value = inner::byteswap(n.value);
+                n.feat_id = inner::byteswap(n.feat_id);
+                n.left = inner::byteswap(n.left);
+            }
+            for (NodeId& p : parents) p = inner::byteswap(p);
+        }
+
+        trees_.clear();
+        base_score = h.base_score;
+        for (size_t i = 0; i < h.num_trees; ++i)
+        {
+            if (offsets[i] >= offsets[i+1] || offsets[i+1] > h.num_nodes)
+                throw std::runtime_error("binary model: invalid tree offsets");
+            size_t begin = offsets[i], end = offsets[i+1];
+            inner::validate_tree(&nodes[begin], &parents[begin], end - begin);
+
+            Tree& t = add_tree();
+            t.storage_->nodes.assign(nodes.begin() + begin, nodes.begin() + end);
+            t.storage_->parents.assign(parents.begin() + begin, parents.begin() + end);
+            t.sync_();
+        }
+    }
+
+#ifndef _WIN32
+    bool
+    AddTree::map_fd_(int fd, const std::string& what)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            throw std::runtime_error("cannot stat " + what);
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // the mapping stays valid
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("cannot mmap " + what);
+
+        // the mapping lives as long as any tree refers to it
+        std::shared_ptr<const void> owner(addr, [size](const void *p) {
+            munmap(const_cast<void *>(p), size);
+        });
+
+        const char *buf = static_cast<const char *>(addr);
+        inner::BinaryHeader h;
+        if (inner::read_header(buf, size, h)) // other byte order
+            return false;
+
+        inner::BinaryLayout layout(h.num_trees, h.num_nodes);
+        const uint64_t *offsets = reinterpret_cast<const uint64_t *>(
+                buf + layout.tree_offset_pos);
+        const inner::Node *nodes = reinterpret_cast<const inner::Node *>(
+                buf + layout.nodes_pos);
+        const NodeId *parents = reinterpret_cast<const NodeId *>(
+                buf + layout.parents_pos);
+
+        std::vector<Tree> trees;
+        trees.reserve(h.num_trees);
+        for (size_t i = 0; i < h.num_trees; ++i)
+        {
+            if (offsets[i] >= offsets[i+1] || offsets[i+1] > h.num_nodes)
+                throw std::runtime_error("binary model: invalid tree offsets");
+            size_t begin = offsets[i], end = offsets[i+1];
+            inner::validate_tree(nodes + begin, parents + begin, end - begin);
+            trees.push_back(Tree(nodes + begin, parents + begin, end - begin, owner));
+        }
+
+        trees_ = std::move(trees);
+        base_score = h.base_score;
+        return true;
+    }
+#endif
+
+    void
+    AddTree::map_binary(const std::string& path)
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open " + path);
+        if (map_fd_(fd, path))
+            return;
+#endif
+        // other byte order or no mmap: convert into a copy
+        std::ifstream f(path, std::ios::binary);
+        if (!f)
+            throw std::runtime_error("cannot open " + path);
+        from_binary(f);
+    }
+
+#ifndef _WIN32
+    namespace inner {
+        /** Stream buffer writing into a fixed memory region. */
+        struct MemoryBuf : public std::streambuf {
+            MemoryBuf(char *p, size_t n) { setp(p, p + n); }
+        };
+    } // namespace inner
+
+    void
+    AddTree::to_shared_memory(const std::string& name) const
+    {
+        size_t size = inner::BinaryLayout(this->size(), num_nodes()).size;
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            throw std::runtime_error("cannot create shared memory " + name);
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("cannot resize shared memory " + name);
+        }
+        void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("cannot mmap shared memory " + name);
+        }
+
+        try
+        {
+            inner::MemoryBuf buf(static_cast<char *>(addr), size);
+            std::ostream s(&buf);
+            to_binary(s);
+        }
+        catch (...)
+        {
+            munmap(addr, size);
+            shm_unlink(name.c_str());
+            throw;
+        }
+        munmap(addr, size);
+    }
+
+    void
+    AddTree::attach_shared_memory(const std::string& name)
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            throw std::runtime_error("cannot open shared memory " + name);
+        if (!map_fd_(fd, "shared memory " + name))
+            throw std::runtime_error("shared memory " + name + ": other byte order");
+    }
+
+    void
+    AddTree::unlink_shared_memory(const std::string& name)
+    {
+        if (shm_unlink(name.c_str()) != 0)
+            throw std::runtime_error("cannot unlink shared memory " + name);
+    }
+#else
+    void
+    AddTree::to_shared_memory(const std::string&) const
+    { throw std::runtime_error("shared memory not supported on this platform"); }
+
+    void
+    AddTree::attach_shared_memory(const std::string&)
+    { throw std::runtime_error("shared memory not supported on this platform"); }
+
+    void
+    AddTree::unlink_shared_memory(const std::string&)
+    { throw std::runtime_error("shared memory not supported on this platform"); }
+#endif
+
+} // namespace veritas
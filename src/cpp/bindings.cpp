@@ -7,8 +7,12 @@
 #include <memory>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <iostream>
 #include <cstring>
+#include <tuple>
+#include <cstddef>
+#include <algorithm>
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
@@ -20,8 +24,17 @@
 #include "domain.hpp"
 #include "features.hpp"
 #include "tree.hpp"
+#include "compiled.hpp"
+#include "quickscorer.hpp"
+#include "native.hpp"
+#include "json.hpp"
+#include "xgb.hpp"
+#include "lgb.hpp"
 //#include "graph_search.hpp"
 #include "search.hpp"
+#include "partitioned_search.hpp"
+#include "portfolio_search.hpp"
+#include "robustness.hpp"
 #include "constraints.hpp"
 
 namespace py = pybind11;
@@ -80,6 +93,37 @@ tobox(py::object pybox)
     return box;
 }
 
+using IndexArray = py::array_t<int64_t, py::array::c_style | py::array::forcecast>;
+using ValueArray = py::array_t<double, py::array::c_style | py::array::forcecast>;
+using TreeArraysTuple = std::tuple<IndexArray, IndexArray, IndexArray, ValueArray, ValueArray>;
+
+/* Borrow the node arrays, which must outlive the result. Arrays of the right
+ * dtype and layout (e.g. scikit-learn's `tree_` arrays) are not copied. */
+TreeArrays
+get_tree_arrays(const TreeArraysTuple& t, bool threshold_le)
+{
+    const auto& [left, right, feature, threshold, value] = t;
+    size_t n = static_cast<size_t>(left.size());
+    if (left.ndim() != 1 || static_cast<size_t>(right.size()) != n
+            || static_cast<size_t>(feature.size()) != n
+            || static_cast<size_t>(threshold.size()) != n
+            || static_cast<size_t>(value.size()) != n)
+        throw std::runtime_error("node arrays must be 1-d and of equal length");
+    return { n, left.data(), right.data(), feature.data(), threshold.data(),
+        value.data(), threshold_le };
+}
+
+/* Read-only 1-d numpy view on `n` values of type T, `stride` bytes apart.
+ * `base` keeps the memory alive. */
+template <typename T>
+py::array
+readonly_view(const void *ptr, size_t n, size_t stride, py::handle base)
+{
+    py::array a(py::dtype::of<T>(), {n}, {stride}, static_cast<const T *>(ptr), base);
+    a.attr("setflags")(py::arg("write") = false);
+    return a;
+}
+
 data
 get_data(py::handle h)
 {
@@ -173,6 +217,12 @@ PYBIND11_MODULE(pyveritas, m) {
         ; // LtSplit
 
 
+    py::enum_<NodeLayout>(m, "NodeLayout")
+        .value("BFS", NodeLayout::BFS)
+        .value("DFS_HOT", NodeLayout::DFS_HOT)
+        .value("VEB", NodeLayout::VEB)
+        ; // NodeLayout
+
     /* Avoid invalid pointers to Tree's by storing indexes rather than pointers */
     struct TreeRef {
         std::shared_ptr<AddTree> at;
@@ -192,6 +242,39 @@ PYBIND11_MODULE(pyveritas, m) {
         .def("right", [](const TreeRef& r, NodeId n) { return r.get()[n].right().id(); })
         .def("parent", [](const TreeRef& r, NodeId n) { return r.get()[n].parent().id(); })
         .def("tree_size", [](const TreeRef& r, NodeId n) { return r.get()[n].tree_size(); })
+        .def("is_view", [](const TreeRef& r) { return r.get().is_view(); })
+        .def("is_shared", [](const TreeRef& r) { return r.get().is_shared(); })
+        .def("has_leaf_transform", [](const TreeRef& r) { return r.get().has_leaf_transform(); })
+        .def("cache_minmax", [](TreeRef& r) { r.get().cache_minmax(); })
+        .def("has_minmax_cache", [](const TreeRef& r) { return r.get().has_minmax_cache(); })
+        .def("node_arrays", [](const TreeRef& r) {
+            // views on the node storage; the capsule keeps that storage
+            // alive, and a later mutation of the tree copies it first
+            const Tree& t = r.get();
+            py::capsule self(new std::shared_ptr<const void>(t.data_owner()),
+                    [](void *p) { delete static_cast<std::shared_ptr<const void> *>(p); });
+            const char *nodes = reinterpret_cast<const char *>(t.node_data());
+            size_t n = t.num_nodes(), stride = sizeof(inner::Node);
+            py::dict d;
+            d["feat_id"] = readonly_view<FeatId>(nodes + offsetof(inner::Node, feat_id), n, stride, self);
+            if (!t.has_leaf_transform())
+                d["value"] = readonly_view<FloatT>(nodes + offsetof(inner::Node, value), n, stride, self);
+            else // leaf values are computed, so this one is a copy
+            {
+                py::array_t<FloatT> value(n);
+                FloatT *v = value.mutable_data();
+                for (size_t i = 0; i < n; ++i)
+                {
+                    const inner::Node& node = t.node_data()[i];
+                    v[i] = node.is_leaf() ? t.transform_leaf_value(node.value) : node.value;
+                }
+                value.attr("setflags")(py::arg("write") = false);
+                d["value"] = value;
+            }
+            d["left"] = readonly_view<NodeId>(nodes + offsetof(inner::Node, left), n, stride, self);
+            d["parent"] = readonly_view<NodeId>(t.parent_data(), n, sizeof(NodeId), self);
+            return d;
+        })
         .def("depth", [](const TreeRef& r, NodeId n) { return r.get()[n].depth(); })
         .def("get_leaf_value", [](const TreeRef& r, NodeId n) { return r.get()[n].leaf_value(); })
         .def("get_split", [](const TreeRef& r, NodeId n) { return r.get()[n].get_split(); })
@@ -227,6 +310,13 @@ PYBIND11_MODULE(pyveritas, m) {
             return result;
         })
 
+        .def("compute_visit_counts", [](const TreeRef& r, py::handle arr) {
+            return r.get().compute_visit_counts(get_data(arr));
+        })
+        .def("relayout", [](TreeRef& r, NodeLayout layout, const std::vector<size_t>& visit_counts) {
+            return r.get().relayout(layout, visit_counts);
+        }, py::arg("layout"), py::arg("visit_counts") = std::vector<size_t>{})
+
         .def("__str__", [](const TreeRef& r) { return tostr(r.get()); })
         .def("compute_box", [](const TreeRef& r, NodeId n) {
             Box box = r.get()[n].compute_box();
@@ -256,6 +346,45 @@ PYBIND11_MODULE(pyveritas, m) {
                 throw py::value_error("out of bounds access into AddTree");
             })
         .def("__len__", &AddTree::size)
+        .def("node_arrays", [](const AddTree& at) {
+            // the nodes of all trees, concatenated; tree t is in
+            // [tree_offset[t], tree_offset[t+1]) and keeps its own node ids
+            size_t n = at.num_nodes();
+            py::array_t<FeatId> feat_id(n);
+            py::array_t<FloatT> value(n);
+            py::array_t<NodeId> left(n), parent(n);
+            py::array_t<int64_t> tree_offset(at.size() + 1);
+            FeatId *f = feat_id.mutable_data();
+            FloatT *v = value.mutable_data();
+            NodeId *l = left.mutable_data(), *p = parent.mutable_data();
+            int64_t *o = tree_offset.mutable_data();
+
+            size_t offset = 0;
+            for (size_t i = 0; i < at.size(); ++i)
+            {
+                const Tree& t = at[i];
+                o[i] = static_cast<int64_t>(offset);
+                const inner::Node *nodes = t.node_data();
+                for (size_t j = 0; j < t.num_nodes(); ++j, ++offset)
+                {
+                    f[offset] = nodes[j].feat_id;
+                    v[offset] = nodes[j].is_leaf()
+                        ? t.transform_leaf_value(nodes[j].value) : nodes[j].value;
+                    l[offset] = nodes[j].left;
+                }
+                std::copy(t.parent_data(), t.parent_data() + t.num_nodes(),
+                        p + o[i]);
+            }
+            o[at.size()] = static_cast<int64_t>(offset);
+
+            py::dict d;
+            d["feat_id"] = feat_id;
+            d["value"] = value;
+            d["left"] = left;
+            d["parent"] = parent;
+            d["tree_offset"] = tree_offset;
+            return d;
+        })
         .def("num_nodes", &AddTree::num_nodes)
         .def("num_leafs", &AddTree::num_leafs)
         .def("get_splits", &AddTree::get_splits)
@@ -264,6 +393,26 @@ PYBIND11_MODULE(pyveritas, m) {
         .def("add_tree", [](const std::shared_ptr<AddTree>& at, const TreeRef& tref) {
                 at->add_tree(tref.get()); // copy
                 return TreeRef{at, at->size()-1}; })
+        .def("add_tree_from_arrays", [](const std::shared_ptr<AddTree>& at,
+                    IndexArray left, IndexArray right, IndexArray feature,
+                    ValueArray threshold, ValueArray value, bool threshold_le) {
+                TreeArraysTuple t{left, right, feature, threshold, value};
+                at->add_tree_from_arrays(get_tree_arrays(t, threshold_le));
+                return TreeRef{at, at->size()-1};
+            }, py::arg("children_left"), py::arg("children_right"), py::arg("feature"),
+            py::arg("threshold"), py::arg("value"), py::arg("threshold_le") = true)
+        .def("add_trees_from_arrays", [](AddTree& at,
+                    const std::vector<TreeArraysTuple>& trees, bool threshold_le,
+                    size_t num_threads) {
+                std::vector<TreeArrays> arrays;
+                arrays.reserve(trees.size());
+                for (const TreeArraysTuple& t : trees)
+                    arrays.push_back(get_tree_arrays(t, threshold_le));
+
+                py::gil_scoped_release release;
+                ThreadPool pool(num_threads);
+                at.add_trees_from_arrays(arrays, pool);
+            }, py::arg("trees"), py::arg("threshold_le") = true, py::arg("num_threads") = 0)
         .def("prune", [](AddTree& at, const py::object& pybox) {
             Box box = tobox(pybox);
             BoxRef b(box);
@@ -283,6 +432,50 @@ PYBIND11_MODULE(pyveritas, m) {
             at.from_json(s);
             return at;
         })
+        .def("to_json_stream", [](const AddTree& at, py::function write) {
+            // `write` is called with chunks of bytes, e.g. a gzip file's write
+            JsonWriter w([&write](const char *data, size_t n) {
+                write(py::bytes(data, n));
+            });
+            at.to_json(w);
+            w.flush();
+        })
+        .def_static("from_json_stream", [](py::function read) {
+            // `read(n)` returns at most n bytes, empty at the end
+            JsonReader r([&read](char *buf, size_t cap) {
+                // bytes, or str from a text stream
+                std::string v = read(cap).cast<std::string>();
+                if (v.size() > cap)
+                    throw std::runtime_error("read returned too many bytes");
+                std::memcpy(buf, v.data(), v.size());
+                return v.size();
+            });
+            AddTree at;
+            at.from_json(r);
+            return at;
+        })
+        .def("to_binary", [](const AddTree& at, const std::string& path) {
+            at.to_binary(path);
+        })
+        .def_static("from_binary", [](const std::string& path) {
+            AddTree at;
+            std::ifstream f(path, std::ios::binary);
+            if (!f) throw std::runtime_error("cannot open " + path);
+            at.from_binary(f);
+            return at;
+        })
+        .def_static("map_binary", [](const std::string& path) {
+            AddTree at;
+            at.map_binary(path);
+            return at;
+        })
+        .def("to_shared_memory", &AddTree::to_shared_memory)
+        .def_static("attach_shared_memory", [](const std::string& name) {
+            AddTree at;
+            at.attach_shared_memory(name);
+            return at;
+        })
+        .def_static("unlink_shared_memory", &AddTree::unlink_shared_memory)
         .def("eval", [](const AddTree& at, py::handle arr) {
             data d = get_data(arr);
 
@@ -318,21 +511,138 @@ PYBIND11_MODULE(pyveritas, m) {
             return d;
         })
         .def("concat_negated", &AddTree::concat_negated)
+        .def("relayout", [](AddTree& at, NodeLayout layout, py::object calibration) {
+            if (calibration.is_none())
+                return at.relayout(layout);
+            return at.relayout(layout, get_data(calibration));
+        }, py::arg("layout"), py::arg("calibration") = py::none())
+        .def("compile", [](const AddTree& at) { return CompiledAddTree(at); })
+        .def("compile_to_source", [](const AddTree& at, const std::string& path) {
+            at.compile_to_source(path);
+        })
+        .def("compile_native", &NativePredictor::build, py::arg("so_path"),
+                py::arg("compiler") = "c++", py::arg("flags") = "-O2")
         .def("__str__", [](const AddTree& at) { return tostr(at); })
         .def(py::pickle(
             [](const AddTree& at) { // __getstate__
                 std::stringstream s;
-                at.to_json(s);
-                return s.str();
+                at.to_binary(s);
+                return py::bytes(s.str());
             },
-            [](const std::string& json) { // __setstate__
+            [](py::object state) { // __setstate__
                 AddTree at;
-                std::stringstream s(json);
-                at.from_json(s);
+                if (py::isinstance<py::str>(state)) // older pickles store json
+                {
+                    std::stringstream s(state.cast<std::string>());
+                    at.from_json(s);
+                }
+                else
+                {
+                    std::stringstream s(state.cast<std::string>());
+                    at.from_binary(s);
+                }
                 return at;
             }))
         ; // AddTree
 
+    py::enum_<SimdIsa>(m, "SimdIsa")
+        .value("SCALAR", SimdIsa::SCALAR)
+        .value("AVX2", SimdIsa::AVX2)
+        .value("AVX512", SimdIsa::AVX512)
+        ; // SimdIsa
+
+    m.def("cpu_supports", &cpu_supports);
+
+    m.def("addtrees_from_xgb_file", &addtrees_from_xgb_file,
+            "Read an XGBoost JSON or UBJSON (.ubj) model file, one AddTree per output group");
+    m.def("addtrees_from_lgb_file", &addtrees_from_lgb_file,
+            "Read a LightGBM text model file, one AddTree per output group");
+    m.def("addtrees_from_lgb_string", [](const std::string& model) {
+                std::istringstream s(model);
+                return addtrees_from_lgb_text(s);
+            }, "Read a LightGBM text model from a string (Booster.model_to_string)");
+
+    py::class_<CompiledAddTree>(m, "CompiledAddTree")
+        .def(py::init<const AddTree&>())
+        .def_readonly("base_score", &CompiledAddTree::base_score)
+        .def_property("simd_isa", &CompiledAddTree::simd_isa, &CompiledAddTree::set_simd_isa)
+        .def("__len__", &CompiledAddTree::size)
+        .def("num_nodes", &CompiledAddTree::num_nodes)
+        .def("eval", [](const CompiledAddTree& cat, py::handle arr, size_t num_threads) {
+            data d = get_data(arr);
+
+            auto result = py::array_t<FloatT>(d.num_rows);
+            py::buffer_info out = result.request();
+            FloatT *out_ptr = static_cast<FloatT *>(out.ptr);
+
+            py::gil_scoped_release release; // `arr` and `result` are kept alive by the caller
+            if (num_threads == 1)
+            {
+                cat.eval(d, out_ptr);
+            }
+            else
+            {
+                ThreadPool pool(num_threads);
+                cat.eval(d, out_ptr, pool);
+            }
+
+            return result;
+        }, py::arg("data"), py::arg("num_threads") = 1)
+        .def("eval_node", [](const CompiledAddTree& cat, py::handle arr, size_t tree_index) {
+            if (tree_index >= cat.size())
+                throw py::value_error("out of bounds access into CompiledAddTree");
+            data d = get_data(arr);
+
+            auto result = py::array_t<NodeId>(d.num_rows);
+            py::buffer_info out = result.request();
+            NodeId *out_ptr = static_cast<NodeId *>(out.ptr);
+
+            for (size_t i = 0; i < static_cast<size_t>(d.num_rows); ++i)
+                out_ptr[i] = cat.eval_node(tree_index, d.row(i));
+
+            return result;
+        })
+        ; // CompiledAddTree
+
+    py::class_<QuickScorer>(m, "QuickScorer")
+        .def(py::init<const AddTree&>())
+        .def_readonly("base_score", &QuickScorer::base_score)
+        .def("__len__", &QuickScorer::size)
+        .def("num_splits", &QuickScorer::num_splits)
+        .def("eval", [](const QuickScorer& qs, py::handle arr) {
+            data d = get_data(arr);
+
+            auto result = py::array_t<FloatT>(d.num_rows);
+            py::buffer_info out = result.request();
+            FloatT *out_ptr = static_cast<FloatT *>(out.ptr);
+
+            py::gil_scoped_release release;
+            qs.eval(d, out_ptr);
+
+            return result;
+        })
+        ; // QuickScorer
+
+    py::class_<NativePredictor>(m, "NativePredictor")
+        .def(py::init<const std::string&>())
+        .def("__len__", &NativePredictor::size)
+        .def("eval", [](const NativePredictor& np, py::handle arr) {
+            data d = get_data(arr);
+
+            auto result = py::array_t<FloatT>(d.num_rows);
+            py::buffer_info out = result.request();
+            FloatT *out_ptr = static_cast<FloatT *>(out.ptr);
+
+            py::gil_scoped_release release;
+            np.eval(d, out_ptr);
+
+            return result;
+        })
+        .def("is_bit_exact", [](const NativePredictor& np, const AddTree& at, py::handle arr) {
+            return np.is_bit_exact(at, get_data(arr));
+        })
+        ; // NativePredictor
+
     py::class_<FeatMap>(m, "FeatMap")
         .def(py::init<FeatId>())
         .def(py::init<const std::vector<std::string>&>())
@@ -386,9 +696,25 @@ PYBIND11_MODULE(pyveritas, m) {
         ; // StopReason
 
 
+    py::class_<PreparedEnsemble, std::shared_ptr<PreparedEnsemble>>(m, "PreparedEnsemble")
+        .def(py::init([](const AddTree& at) {
+            return std::make_shared<PreparedEnsemble>(at); }))
+        .def("num_trees", &PreparedEnsemble::num_trees)
+        .def("addtree", &PreparedEnsemble::addtree)
+        .def("mem_size", &PreparedEnsemble::mem_size)
+        ; // PreparedEnsemble
+
     py::class_<VSearch, std::shared_ptr<VSearch>>(m, "Search")
-        .def_static("max_output", &VSearch::max_output)
-        .def_static("min_dist_to_example", &VSearch::min_dist_to_example)
+        .def_static("max_output", py::overload_cast<const AddTree&>(&VSearch::max_output))
+        .def_static("max_output", [](std::shared_ptr<PreparedEnsemble> prep) {
+            return VSearch::max_output(prep); })
+        .def_static("min_dist_to_example", py::overload_cast<const AddTree&,
+                const std::vector<FloatT>&, FloatT>(&VSearch::min_dist_to_example))
+        .def_static("min_dist_to_example", [](std::shared_ptr<PreparedEnsemble> prep,
+                    const std::vector<FloatT>& example, FloatT output_threshold) {
+            return VSearch::min_dist_to_example(prep, example, output_threshold); })
+        .def("prepared", [](const VSearch& s) {
+            return std::const_pointer_cast<PreparedEnsemble>(s.prepared()); })
         .def("step", &VSearch::step)
         .def("steps", &VSearch::steps)
         .def("step_for", &VSearch::step_for)
@@ -415,6 +741,11 @@ PYBIND11_MODULE(pyveritas, m) {
             BoxRef b(box);
             return s.prune_by_box(b);
         })
+        .def("restrict", [](VSearch& s, const py::object& pybox) {
+            Box box = tobox(pybox);
+            BoxRef b(box);
+            return s.restrict_to_box(b);
+        })
         .def("get_solstate_field", [](const VSearch& s, size_t index, const std::string& field) -> py::object {
             if (const auto* v = dynamic_cast<const Search<MaxOutputHeuristic>*>(&s))
             {
@@ -477,6 +808,10 @@ PYBIND11_MODULE(pyveritas, m) {
         .def_readwrite("debug", &VSearch::debug)
         .def_readwrite("max_focal_size", &VSearch::max_focal_size)
         .def_readwrite("auto_eps", &VSearch::auto_eps)
+        .def_readwrite("incremental_heuristic", &VSearch::incremental_heuristic)
+        .def_readwrite("tree_cache_slots", &VSearch::tree_cache_slots)
+        .def_readwrite("use_leaf_tables", &VSearch::use_leaf_tables)
+        .def_readwrite("num_threads", &VSearch::num_threads)
         .def_readwrite("reject_solution_when_output_less_than", &VSearch::reject_solution_when_output_less_than)
 
         // stop condition
@@ -508,8 +843,113 @@ PYBIND11_MODULE(pyveritas, m) {
         .def_readonly("eps", &Snapshot::eps)
         .def_readonly("bounds", &Snapshot::bounds)
         .def_readonly("avg_focal_size", &Snapshot::avg_focal_size)
+        .def_readonly("num_cache_hits", &Snapshot::num_cache_hits)
+        .def_readonly("num_cache_misses", &Snapshot::num_cache_misses)
         ; // Snapshot
 
+    using MaxOutputPartitionedSearch = PartitionedSearch<MaxOutputHeuristic>;
+    py::class_<MaxOutputPartitionedSearch>(m, "PartitionedSearch")
+        .def(py::init<const AddTree&, size_t, size_t>(),
+                py::arg("at"), py::arg("num_parts"), py::arg("num_threads") = 0)
+        .def("steps", &MaxOutputPartitionedSearch::steps)
+        .def("step_for", &MaxOutputPartitionedSearch::step_for)
+        .def("num_parts", &MaxOutputPartitionedSearch::num_parts)
+        .def("part_box", [](const MaxOutputPartitionedSearch& s, size_t part) {
+            py::dict d;
+            for (auto&& [feat_id, dom] : s.part_box(part))
+                d[py::int_(feat_id)] = dom;
+            return d;
+        })
+        .def("is_active", &MaxOutputPartitionedSearch::is_active)
+        .def("set_mem_capacity", &MaxOutputPartitionedSearch::set_mem_capacity)
+        .def("time_since_start", &MaxOutputPartitionedSearch::time_since_start)
+        .def("current_bounds", &MaxOutputPartitionedSearch::current_bounds)
+        .def("is_optimal", &MaxOutputPartitionedSearch::is_optimal)
+        .def("num_solutions", &MaxOutputPartitionedSearch::num_solutions)
+        .def("num_open", &MaxOutputPartitionedSearch::num_open)
+        .def("best_part", &MaxOutputPartitionedSearch::best_part)
+        .def("get_best_solution", &MaxOutputPartitionedSearch::get_best_solution)
+        ; // PartitionedSearch
+
+    py::enum_<TreeOrder>(m, "TreeOrder")
+        .value("AS_IS", TreeOrder::AS_IS)
+        .value("REVERSED", TreeOrder::REVERSED)
+        .value("LEAF_VALUE_VARIANCE", TreeOrder::LEAF_VALUE_VARIANCE)
+        ; // TreeOrder
+
+    py::class_<PortfolioConfig>(m, "PortfolioConfig")
+        .def(py::init<>())
+        .def_readwrite("eps", &PortfolioConfig::eps)
+        .def_readwrite("auto_eps", &PortfolioConfig::auto_eps)
+        .def_readwrite("max_focal_size", &PortfolioConfig::max_focal_size)
+        .def_readwrite("tree_order", &PortfolioConfig::tree_order)
+        ; // PortfolioConfig
+
+    using MaxOutputPortfolioSearch = PortfolioSearch<MaxOutputHeuristic>;
+    py::class_<MaxOutputPortfolioSearch>(m, "PortfolioSearch")
+        .def(py::init<const AddTree&, std::vector<PortfolioConfig>>(),
+                py::arg("at"), py::arg("configs") = MaxOutputPortfolioSearch::default_configs())
+        .def_static("default_configs", &MaxOutputPortfolioSearch::default_configs)
+        .def("step_for", &MaxOutputPortfolioSearch::step_for)
+        .def("num_configs", &MaxOutputPortfolioSearch::num_configs)
+        .def("config", &MaxOutputPortfolioSearch::config)
+        .def("is_active", &MaxOutputPortfolioSearch::is_active)
+        .def("time_since_start", &MaxOutputPortfolioSearch::time_since_start)
+        .def("current_bounds", &MaxOutputPortfolioSearch::current_bounds)
+        .def("is_optimal", &MaxOutputPortfolioSearch::is_optimal)
+        .def("best_config", &MaxOutputPortfolioSearch::best_config)
+        .def("get_best_solution", &MaxOutputPortfolioSearch::get_best_solution)
+        ; // PortfolioSearch
+
+    py::class_<RobustnessSearch>(m, "BatchRobustnessSearch")
+        .def(py::init([](std::shared_ptr<AddTree> source_at, std::shared_ptr<AddTree> target_at) {
+            // None: no source or target ensemble
+            return new RobustnessSearch(source_at ? *source_at : AddTree(),
+                                        target_at ? *target_at : AddTree());
+        }), py::arg("source_at"), py::arg("target_at"))
+        .def_readwrite("start_delta", &RobustnessSearch::start_delta)
+        .def_readwrite("num_steps", &RobustnessSearch::num_steps)
+        .def_readwrite("guard", &RobustnessSearch::guard)
+        .def_readwrite("mem_capacity", &RobustnessSearch::mem_capacity)
+        .def_readwrite("num_threads", &RobustnessSearch::num_threads)
+        .def("search", [](const RobustnessSearch& rob, py::handle arr, py::object max_time) {
+            data d = get_data(arr);
+
+            std::vector<double> max_times;
+            if (py::isinstance<py::float_>(max_time) || py::isinstance<py::int_>(max_time))
+                max_times.assign(d.num_rows, max_time.cast<double>());
+            else
+                max_times = max_time.cast<std::vector<double>>();
+
+            std::vector<RobustnessResult> res;
+            {
+                py::gil_scoped_release release; // `arr` is kept alive by the caller
+                res = rob.search(d, max_times);
+            }
+
+            // examples without an adversarial example get a row of NaNs
+            auto delta = py::array_t<FloatT>(d.num_rows);
+            auto lower = py::array_t<FloatT>(d.num_rows);
+            auto upper = py::array_t<FloatT>(d.num_rows);
+            auto examples = py::array_t<FloatT>({d.num_rows, d.num_cols});
+            auto delta_ptr = delta.mutable_unchecked<1>();
+            auto lower_ptr = lower.mutable_unchecked<1>();
+            auto upper_ptr = upper.mutable_unchecked<1>();
+            auto examples_ptr = examples.mutable_unchecked<2>();
+            for (size_t i = 0; i < d.num_rows; ++i)
+            {
+                delta_ptr(i) = res[i].delta;
+                lower_ptr(i) = res[i].lower;
+                upper_ptr(i) = res[i].upper;
+                for (size_t j = 0; j < d.num_cols; ++j)
+                    examples_ptr(i, j) = res[i].example.empty()
+                        ? std::numeric_limits<FloatT>::quiet_NaN()
+                        : res[i].example[j];
+            }
+            return py::make_tuple(delta, lower, upper, examples);
+        }, py::arg("examples"), py::arg("max_time"))
+        ; // BatchRobustnessSearch
+
 
 
 } /* PYBIND11_MODULE */
@@ -0,0 +1,171 @@
+/**
+ * \file box_cache.hpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_BOX_CACHE_HPP
+#define VERITAS_BOX_CACHE_HPP
+
+#include "domain.hpp"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Fixed-size, lossy cache of one value per tree and box, keyed by the
+     * projection of the box onto the features the tree splits on. Many
+     * search states share the same restrictions on a tree's few features,
+     * so heuristics can skip the tree traversal on a hit.
+     *
+     * Each tree has `slots_per_tree` direct-mapped slots. A slot is guarded
+     * by a sequence counter (a seqlock): readers never block and simply miss
+     * when a write is in progress, writers give up when a slot is busy. Safe
+     * for concurrent use.
+     */
+    class BoxCache {
+        using Word = std::atomic<uint64_t>;
+
+        std::vector<std::vector<FeatId>> tree_feats_;
+        std::vector<size_t> tree_offset_; // slot array offset of each tree
+        size_t slots_per_tree_ = 0;
+        size_t num_words_ = 0;
+        std::unique_ptr<Word[]> words_;
+
+        mutable std::atomic<size_t> hits_{0};
+        mutable std::atomic<size_t> misses_{0};
+
+        // slot layout: [sequence, value, key...]
+        inline size_t slot_size_(size_t tree_index) const
+        { return 2 + tree_feats_[tree_index].size(); }
+
+        inline Word *slot_(size_t tree_index, uint64_t hash) const
+        {
+            size_t slot = static_cast<size_t>(hash % slots_per_tree_);
+            return &words_[tree_offset_[tree_index]
+                + slot * slot_size_(tree_index)];
+        }
+
+        static inline uint64_t hash_(const std::vector<uint64_t>& key)
+        {
+            uint64_t h = 0x9e3779b97f4a7c15ull;
+            for (uint64_t k : key)
+            {
+                h ^= k + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+                h *= 0xbf58476d1ce4e5b9ull;
+            }
+            return h ^ (h >> 31);
+        }
+
+        static inline uint64_t bits_(FloatT x)
+        {
+            uint32_t b;
+            std::memcpy(&b, &x, sizeof(b));
+            return b;
+        }
+
+        static inline FloatT value_(uint64_t b)
+        {
+            uint32_t b32 = static_cast<uint32_t>(b);
+            FloatT x;
+            std::memcpy(&x, &b32, sizeof(x));
+            return x;
+        }
+
+    public:
+        BoxCache() {}
+
+        /**
+         * Allocate an empty cache for trees splitting on the given sorted
+         * feature ids. `slots_per_tree == 0` disables the cache.
+         */
+        void reset(std::vector<std::vector<FeatId>> tree_feats, size_t slots_per_tree)
+        {
+            tree_feats_ = std::move(tree_feats);
+            slots_per_tree_ = slots_per_tree;
+            tree_offset_.clear();
+            num_words_ = 0;
+            for (size_t i = 0; i < tree_feats_.size(); ++i)
+            {
+                tree_offset_.push_back(num_words_);
+                num_words_ += slots_per_tree_ * slot_size_(i);
+            }
+            words_.reset(num_words_ > 0 ? new Word[num_words_] : nullptr);
+            for (size_t i = 0; i < num_words_; ++i)
+                words_[i].store(0, std::memory_order_relaxed);
+        }
+
+        /** Forget all values, keep the configuration. */
+        void clear()
+        {
+            for (size_t i = 0; i < num_words_; ++i)
+                words_[i].store(0, std::memory_order_relaxed);
+        }
+
+        inline bool enabled() const { return slots_per_tree_ > 0; }
+        inline size_t slots_per_tree() const { return slots_per_tree_; }
+        inline size_t mem_size() const { return num_words_ * sizeof(Word); }
+        inline size_t num_hits() const { return hits_.load(std::memory_order_relaxed); }
+        inline size_t num_misses() const { return misses_.load(std::memory_order_relaxed); }
+
+        /** Project `flatbox` onto the features of tree `tree_index`. */
+        void make_key(size_t tree_index, const std::vector<Domain>& flatbox,
+                std::vector<uint64_t>& key) const
+        {
+            key.clear();
+            for (FeatId feat_id : tree_feats_[tree_index])
+            {
+                Domain d;
+                if (static_cast<size_t>(feat_id) < flatbox.size())
+                    d = flatbox[feat_id];
+                key.push_back((bits_(d.lo) << 32) | bits_(d.hi));
+            }
+        }
+
+        /** Look up the value of `key`, returns false on a miss. */
+        bool find(size_t tree_index, const std::vector<uint64_t>& key,
+                FloatT& value) const
+        {
+            const Word *slot = slot_(tree_index, hash_(key));
+            uint64_t seq = slot[0].load(std::memory_order_acquire);
+            bool found = seq != 0 && (seq & 1) == 0;
+            for (size_t i = 0; found && i < key.size(); ++i)
+                found = slot[2+i].load(std::memory_order_relaxed) == key[i];
+            uint64_t v = slot[1].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            found = found && slot[0].load(std::memory_order_relaxed) == seq;
+
+            if (found)
+            {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                value = value_(v);
+            }
+            else misses_.fetch_add(1, std::memory_order_relaxed);
+            return found;
+        }
+
+        /** Store the value of `key`, replacing the slot's previous entry. */
+        void insert(size_t tree_index, const std::vector<uint64_t>& key,
+                FloatT value)
+        {
+            Word *slot = slot_(tree_index, hash_(key));
+            uint64_t seq = slot[0].load(std::memory_order_relaxed);
+            if ((seq & 1) != 0 || !slot[0].compare_exchange_strong(seq, seq+1,
+                        std::memory_order_relaxed))
+                return; // another writer is busy, drop this value
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < key.size(); ++i)
+                slot[2+i].store(key[i], std::memory_order_relaxed);
+            slot[1].store(bits_(value), std::memory_order_relaxed);
+            slot[0].store(seq+2, std::memory_order_release);
+        }
+    }; // class BoxCache
+
+} // namespace veritas
+
+#endif // VERITAS_BOX_CACHE_HPP
@@ -0,0 +1,223 @@
+/**
+ * \file compiled.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "compiled.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace veritas {
+
+    namespace inner {
+#ifdef VERITAS_X86_SIMD
+        /*
+         * The vectorized kernels walk a group of rows through tree `t` in
+         * lock step. Lanes that reached a leaf (feat_id == -1) are masked
+         * out until all lanes are done. The split test is `!(x < split)`
+         * -> right, so NaNs go right like in LtSplit::test.
+         *
+         * Return the number of rows processed, a multiple of the number of
+         * lanes. The remaining rows are left for the scalar loop.
+         */
+
+        __attribute__((target("avx2")))
+        static size_t
+        eval_rows_avx2(const FeatId *feat_id, const FloatT *value,
+                const NodeId *left, const std::vector<size_t>& tree_offset,
+                const data& d, FloatT *out)
+        {
+            const size_t num_rows = d.num_rows - d.num_rows % 8;
+            const __m256i lane_offset = _mm256_mullo_epi32(
+                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                    _mm256_set1_epi32(static_cast<int>(d.stride_row)));
+            const __m256i stride_col = _mm256_set1_epi32(static_cast<int>(d.stride_col));
+            const __m256i minus_one = _mm256_set1_epi32(-1);
+
+            for (size_t offset : tree_offset)
+            {
+                const __m256i root = _mm256_set1_epi32(static_cast<int>(offset));
+                for (size_t r = 0; r < num_rows; r += 8)
+                {
+                    const FloatT *base = d.ptr + d.index(r, 0);
+                    __m256i idx = root;
+                    for (;;)
+                    {
+                        __m256i fid = _mm256_i32gather_epi32(feat_id, idx, 4);
+                        __m256i active = _mm256_cmpgt_epi32(fid, minus_one);
+                        if (_mm256_testz_si256(active, active))
+                            break;
+
+                        __m256 split = _mm256_i32gather_ps(value, idx, 4);
+                        __m256i xoff = _mm256_add_epi32(lane_offset,
+                                _mm256_mullo_epi32(fid, stride_col));
+                        __m256 x = _mm256_mask_i32gather_ps(_mm256_setzero_ps(),
+                                base, xoff, _mm256_castsi256_ps(active), 4);
+                        __m256 go_right = _mm256_cmp_ps(x, split, _CMP_NLT_UQ);
+                        __m256i l = _mm256_i32gather_epi32(left, idx, 4);
+                        // go_right lanes are -1: subtracting adds one
+                        __m256i next = _mm256_sub_epi32(l, _mm256_castps_si256(go_right));
+                        idx = _mm256_blendv_epi8(idx, next, active);
+                    }
+
+                    __m256 leaf_value = _mm256_i32gather_ps(value, idx, 4);
+                    __m256 acc = _mm256_loadu_ps(out + r);
+                    _mm256_storeu_ps(out + r, _mm256_add_ps(acc, leaf_value));
+                }
+            }
+            return num_rows;
+        }
+
+        __attribute__((target("avx512f")))
+        static size_t
+        eval_rows_avx512(const FeatId *feat_id, const FloatT *value,
+                const NodeId *left, const std::vector<size_t>& tree_offset,
+                const data& d, FloatT *out)
+        {
+            const size_t num_rows = d.num_rows - d.num_rows % 16;
+            const __m512i lane_offset = _mm512_mullo_epi32(
+                    _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                    _mm512_set1_epi32(static_cast<int>(d.stride_row)));
+            const __m512i stride_col = _mm512_set1_epi32(static_cast<int>(d.stride_col));
+            const __m512i zero = _mm512_setzero_si512();
+            const __m512i one = _mm512_set1_epi32(1);
+            // masked gathers with an explicit source: the unmasked forms
+            // have an undefined source, which GCC warns about at -O3
+            const __mmask16 all = 0xFFFF;
+
+            for (size_t offset : tree_offset)
+            {
+                const __m512i root = _mm512_set1_epi32(static_cast<int>(offset));
+                for (size_t r = 0; r < num_rows; r += 16)
+                {
+                    const FloatT *base = d.ptr + d.index(r, 0);
+                    __m512i idx = root;
+                    for (;;)
+                    {
+                        __m512i fid = _mm512_mask_i32gather_epi32(zero, all, idx, feat_id, 4);
+                        __mmask16 active = _mm512_cmpge_epi32_mask(fid, zero);
+                        if (active == 0)
+                            break;
+
+                        __m512 split = _mm512_mask_i32gather_ps(_mm512_setzero_ps(),
+                                active, idx, value, 4);
+                        __m512i xoff = _mm512_add_epi32(lane_offset,
+                                _mm512_mullo_epi32(fid, stride_col));
+                        __m512 x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(),
+                                active, xoff, base, 4);
+                        __mmask16 go_right = _mm512_mask_cmp_ps_mask(active, x,
+                                split, _CMP_NLT_UQ);
+                        __m512i l = _mm512_mask_i32gather_epi32(idx, active, idx, left, 4);
+                        l = _mm512_mask_add_epi32(l, go_right, l, one);
+                        idx = _mm512_mask_mov_epi32(idx, active, l);
+                    }
+
+                    __m512 leaf_value = _mm512_mask_i32gather_ps(_mm512_setzero_ps(),
+                            all, idx, value, 4);
+                    __m512 acc = _mm512_loadu_ps(out + r);
+                    _mm512_storeu_ps(out + r, _mm512_add_ps(acc, leaf_value));
+                }
+            }
+            return num_rows;
+        }
+#endif // VERITAS_X86_SIMD
+    } // namespace inner
+
+    CompiledAddTree::CompiledAddTree(const AddTree& at)
+        : isa_(SimdIsa::SCALAR)
+        , base_score(at.base_score)
+    {
+        size_t num_nodes = at.num_nodes();
+        feat_id_.reserve(num_nodes);
+        value_.reserve(num_nodes);
+        left_.reserve(num_nodes);
+        tree_offset_.reserve(at.size());
+
+        for (const Tree& tree : at)
+        {
+            size_t offset = feat_id_.size();
+            tree_offset_.push_back(offset);
+
+            for (size_t i = 0; i < tree.num_nodes(); ++i)
+            {
+                Tree::ConstRef n = tree[static_cast<NodeId>(i)];
+                if (n.is_leaf())
+                {
+                    feat_id_.push_back(-1);
+                    value_.push_back(n.leaf_value());
+                    left_.push_back(-1);
+                }
+                else
+                {
+                    LtSplit split = n.get_split();
+                    max_feat_id_ = std::max(max_feat_id_, split.feat_id);
+                    feat_id_.push_back(split.feat_id);
+                    value_.push_back(split.split_value);
+                    left_.push_back(static_cast<NodeId>(offset) + n.left().id());
+                }
+            }
+        }
+    }
+
+    void
+    CompiledAddTree::set_simd_isa(SimdIsa isa)
+    {
+        if (!cpu_supports(isa))
+            throw std::runtime_error("SIMD instruction set not supported by CPU");
+        isa_ = isa;
+    }
+
+    bool
+    CompiledAddTree::simd_offsets_fit_(const data& d, size_t lanes) const
+    {
+        const size_t int_max = static_cast<size_t>(std::numeric_limits<int>::max());
+        size_t max_offset = (lanes-1) * d.stride_row
+            + static_cast<size_t>(std::max(0, max_feat_id_)) * d.stride_col;
+        return max_offset <= int_max && num_nodes() <= int_max;
+    }
+
+    void
+    CompiledAddTree::eval(const data& d, FloatT *out) const
+    {
+        for (size_t r0 = 0; r0 < d.num_rows; r0 += ROW_BLOCK_SIZE)
+        {
+            size_t r1 = std::min(d.num_rows, r0 + ROW_BLOCK_SIZE);
+            std::fill(out + r0, out + r1, base_score);
+
+            size_t num_simd_rows = 0;
+#ifdef VERITAS_X86_SIMD
+            data block = d.rows(r0, r1);
+            if (isa_ == SimdIsa::AVX512 && simd_offsets_fit_(d, 16))
+                num_simd_rows = inner::eval_rows_avx512(feat_id_.data(), value_.data(),
+                        left_.data(), tree_offset_, block, out + r0);
+            else if (isa_ != SimdIsa::SCALAR && simd_offsets_fit_(d, 8))
+                num_simd_rows = inner::eval_rows_avx2(feat_id_.data(), value_.data(),
+                        left_.data(), tree_offset_, block, out + r0);
+#endif
+
+            // same summation order as AddTree::eval
+            for (size_t offset : tree_offset_)
+                for (size_t r = r0 + num_simd_rows; r < r1; ++r)
+                    out[r] += value_[eval_index_(offset, d.row(r))];
+        }
+    }
+
+    void
+    CompiledAddTree::eval(const data& d, FloatT *out, ThreadPool& pool) const
+    {
+        // a few chunks per thread for load balancing, whole row blocks only
+        size_t num_chunks = pool.num_threads() * 4;
+        size_t num_blocks = (d.num_rows + ROW_BLOCK_SIZE - 1) / ROW_BLOCK_SIZE;
+        size_t chunk_size = ROW_BLOCK_SIZE * std::max<size_t>(1,
+                (num_blocks + num_chunks - 1) / num_chunks);
+
+        pool.parallel_for(0, d.num_rows, chunk_size, [&](size_t r0, size_t r1) {
+            eval(d.rows(r0, r1), out + r0);
+        });
+    }
+
+} // namespace veritas
@@ -0,0 +1,119 @@
+/**
+ * \file compiled.hpp
+ *
+ * A flat, evaluation-only representation of an AddTree. Use this when the
+ * same ensemble is evaluated on many instances.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_COMPILED_HPP
+#define VERITAS_COMPILED_HPP
+
+#include "tree.hpp"
+#include "thread_pool.hpp"
+#include "simd.hpp"
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Immutable copy of an AddTree that only supports evaluation.
+     *
+     * The nodes of all trees are packed in contiguous struct-of-arrays
+     * tables. Node `i` of tree `t` is stored at index `tree_offset(t) + i`,
+     * so node ids remain valid. Internal nodes store their split in
+     * `feat_id` and `value`, and the absolute index of their left child in
+     * `left` (the right child is at `left+1`). Leaf nodes have `feat_id ==
+     * -1` and store their leaf value in `value`.
+     *
+     * The output of CompiledAddTree::eval is bit-exact with AddTree::eval.
+     *
+     * Batches of rows are evaluated by a vectorized kernel that walks 8
+     * (AVX2) or 16 (AVX-512) rows through a tree at once, using gathers to
+     * load the split features. The kernels are opt-in through
+     * CompiledAddTree::set_simd_isa; the default is the scalar loop. In
+     * bench_eval1, AVX2 was slower than the scalar loop and AVX-512 on par
+     * with it.
+     */
+    class CompiledAddTree {
+        std::vector<FeatId> feat_id_;
+        std::vector<FloatT> value_;
+        std::vector<NodeId> left_;
+        std::vector<size_t> tree_offset_;
+        FeatId max_feat_id_ = -1;
+        SimdIsa isa_;
+
+    public:
+        FloatT base_score; /**< See AddTree::base_score */
+
+        /** Number of rows that share the nodes of a tree in CompiledAddTree::eval(const data&, FloatT *). */
+        const static size_t ROW_BLOCK_SIZE = 64;
+
+        explicit CompiledAddTree(const AddTree& at);
+
+        /** Number of trees. */
+        inline size_t size() const { return tree_offset_.size(); }
+        /** Total number of nodes of all trees. */
+        inline size_t num_nodes() const { return feat_id_.size(); }
+        /** Index of the root of tree `tree_index` in the node tables. */
+        inline size_t tree_offset(size_t tree_index) const { return tree_offset_[tree_index]; }
+
+        /** The instruction set used by the batch evaluation kernel. */
+        inline SimdIsa simd_isa() const { return isa_; }
+        /** Select the batch evaluation kernel. Throws when the CPU does not
+         * support `isa`. */
+        void set_simd_isa(SimdIsa isa);
+
+        /** Evaluate tree `tree_index` on an instance, return the node id of the leaf. */
+        inline NodeId eval_node(size_t tree_index, const data& row) const
+        {
+            size_t offset = tree_offset_[tree_index];
+            return static_cast<NodeId>(eval_index_(offset, row) - offset);
+        }
+
+        /** Evaluate the ensemble on the first row of `row`. */
+        inline FloatT eval(const data& row) const
+        {
+            FloatT v = base_score;
+            for (size_t offset : tree_offset_)
+                v += value_[eval_index_(offset, row)];
+            return v;
+        }
+
+        /**
+         * Evaluate the ensemble on all rows of `d` and write the results
+         * to `out`, which must have space for `d.num_rows` values.
+         *
+         * Rows are processed in blocks of ROW_BLOCK_SIZE rows: all rows of a
+         * block go through a tree before moving to the next tree.
+         */
+        void eval(const data& d, FloatT *out) const;
+
+        /**
+         * Like CompiledAddTree::eval(const data&, FloatT *), but split the
+         * rows over the threads of `pool`.
+         */
+        void eval(const data& d, FloatT *out, ThreadPool& pool) const;
+
+    private:
+        /** Can the gather offsets for `lanes` rows of `d` be represented
+         * by 32-bit integers? */
+        bool simd_offsets_fit_(const data& d, size_t lanes) const;
+
+        /** Branch-light, non-recursive traversal from node index `i` to a leaf. */
+        inline size_t eval_index_(size_t i, const data& row) const
+        {
+            FeatId feat_id;
+            while ((feat_id = feat_id_[i]) >= 0)
+                i = static_cast<size_t>(left_[i])
+                    + static_cast<size_t>(!(row[feat_id] < value_[i]));
+            return i;
+        }
+    }; // CompiledAddTree
+
+} // namespace veritas
+
+#endif // VERITAS_COMPILED_HPP
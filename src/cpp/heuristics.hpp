@@ -19,32 +19,89 @@ namespace veritas {
         BoxRef box;
         int indep_set;
 
-        BaseState() : box(BoxRef::null_box()), indep_set(-1) {}
+        /** Per-tree terms of the basic output heuristic for trees
+         * `indep_set+1`, ..., or null. Lets children skip recomputing trees
+         * whose split features kept their domain. */
+        const FloatT *tree_bounds;
+
+        BaseState() : box(BoxRef::null_box()), indep_set(-1), tree_bounds(nullptr) {}
     };
 
     struct BaseHeuristic {
+        /** Search::tree_caches_ used by this heuristic */
+        enum TreeCache { OUTPUT_CACHE = 0, DIST_CACHE = 1 };
+        static constexpr size_t num_tree_caches = 1;
+
+        /**
+         * Term of tree `tree_index` for the box in
+         * `workspace_.leafiter2.flatbox`: looked up in tree cache `c`, or
+         * computed by `compute()` and stored.
+         */
+        template <typename Search, typename F>
+        FloatT cached_tree_term_(const Search& s, TreeCache c,
+                size_t tree_index, F compute) const
+        {
+            BoxCache& cache = s.tree_cache_(c);
+            if (!cache.enabled())
+                return compute();
+
+            std::vector<uint64_t>& key = s.workspace_.cache_key;
+            cache.make_key(tree_index, s.workspace_.leafiter2.flatbox, key);
+            FloatT value;
+            if (!cache.find(tree_index, key, value))
+            {
+                value = compute();
+                cache.insert(tree_index, key, value);
+            }
+            return value;
+        }
+
         /**
          * Compute an overestimate of the remaining output value to a solution
-         * state.
+         * state. The per-tree terms are left in `workspace_.tree_bounds`.
+         * When `parent` has its terms, only the trees that split on a
+         * feature whose domain changed from `parent.box` to `state.box` are
+         * recomputed.
          */
         template <typename Search, typename State>
-        FloatT compute_basic_output_heuristic_(const Search& s, const State& state) const
+        FloatT compute_basic_output_heuristic_(const Search& s,
+                const State& parent, const State& state) const
         {
+            size_t begin = state.indep_set + 1;
+            bool incremental = parent.tree_bounds != nullptr
+                && parent.indep_set + 1 == state.indep_set;
+            if (incremental)
+                s.mark_changed_trees_(parent.box, state.box);
+
             FloatT h = 0.0;
+            s.workspace_.tree_bounds.resize(s.at_.size() - begin);
             s.workspace_.leafiter2.setup_flatbox(state.box); // do once
-            for (size_t tree_index = state.indep_set + 1;
+            for (size_t tree_index = begin;
                     tree_index < s.at_.size(); ++tree_index)
             {
                 FloatT max = -FLOATT_INF;
-                const Tree& t = s.at_[tree_index];
-                s.workspace_.leafiter2.setup_tree(t);
-                NodeId leaf_id = -1;
-                while ((leaf_id = s.workspace_.leafiter2.next()) != -1)
+                if (incremental && !s.workspace_.changed_trees[tree_index])
                 {
-                    if (s.node_box_[tree_index][leaf_id].is_invalid_box())
-                        continue;
-                    max = std::max(t[leaf_id].leaf_value(), max);
+                    // parent's terms start one tree earlier
+                    max = parent.tree_bounds[tree_index - begin + 1];
+                }
+                else
+                {
+                    max = cached_tree_term_(s, OUTPUT_CACHE, tree_index, [&]() {
+                        FloatT max = -FLOATT_INF;
+                        const Tree& t = s.at_[tree_index];
+                        s.workspace_.leafiter2.setup_tree(t);
+                        NodeId leaf_id = -1;
+                        while ((leaf_id = s.workspace_.leafiter2.next(max)) != -1)
+                        {
+                            if (s.prep_->node_box(tree_index)[leaf_id].is_invalid_box())
+                                continue;
+                            max = std::max(t[leaf_id].leaf_value(), max);
+                        }
+                        return max;
+                    });
                 }
+                s.workspace_.tree_bounds[tree_index - begin] = max;
                 h += max;
             }
             return h;
@@ -100,7 +157,7 @@ namespace veritas {
             FloatT g = parent.g + leaf_value;
             //FloatT h = search.graph_.basic_remaining_upbound(out.indep_set+1,
             //        out.box);
-            FloatT h = compute_basic_output_heuristic_(search, out);
+            FloatT h = compute_basic_output_heuristic_(search, parent, out);
 
             if (!std::isinf(h))
             {
@@ -163,6 +220,7 @@ namespace veritas {
 
     struct MinDistToExampleHeuristic : public MinHeuristic {
         using State = MinDistToExampleState;
+        static constexpr size_t num_tree_caches = 2;
         FloatT output_threshold;
         std::vector<FloatT> example;
 
@@ -186,7 +244,7 @@ namespace veritas {
             FloatT g = parent.g + leaf_value;
             //FloatT h = search.graph_.basic_remaining_upbound(out.indep_set+1,
             //        out.box);
-            FloatT h = compute_basic_output_heuristic_(search, out);
+            FloatT h = compute_basic_output_heuristic_(search, parent, out);
             //std::cout << h << ", " << h2 << std::endl;
 
             if (!std::isinf(h) && (g+h) > output_threshold)
@@ -273,7 +331,7 @@ namespace veritas {
                 NodeId leaf_id = -1;
                 while ((leaf_id = s.workspace_.leafiter2.next()) != -1)
                 {
-                    BoxRef box = s.node_box_[tree_index][leaf_id];
+                    BoxRef box = s.prep_->node_box(tree_index)[leaf_id];
                     if (box.is_invalid_box())
                         continue;
 
@@ -315,32 +373,36 @@ namespace veritas {
             for (size_t tree_index = state.indep_set + 1;
                     tree_index < s.at_.size(); ++tree_index)
             {
-                FloatT min_lp = FLOATT_INF;
-                const Tree& t = s.at_[tree_index];
-                s.workspace_.leafiter2.setup_tree(t);
-                NodeId leaf_id = -1;
-                while ((leaf_id = s.workspace_.leafiter2.next()) != -1)
-                {
-                    BoxRef box = s.node_box_[tree_index][leaf_id];
-                    if (box.is_invalid_box())
-                        continue;
-
-                    FloatT lp = lp_state;
-                    for (auto &&[feat_id, dom] : box)
+                // max(lp_state, .) commutes with the min over the leaves, so
+                // the rest only depends on the box on this tree's features
+                FloatT min_lp = cached_tree_term_(s, DIST_CACHE, tree_index, [&]() {
+                    FloatT min_lp = FLOATT_INF;
+                    s.find_overlapping_leafs_(tree_index, s.workspace_.leafiter2,
+                            s.workspace_.leaf_ids2);
+                    for (NodeId leaf_id : s.workspace_.leaf_ids2)
                     {
-                        Domain dom0;
-                        if (static_cast<size_t>(feat_id) <
-                                s.workspace_.leafiter2.flatbox.size())
-                            dom0 = s.workspace_.leafiter2.flatbox[feat_id];
-                        Domain dom1 = dom.intersect(dom0);
-                        FloatT x = example[feat_id];
-                        FloatT d1 = std::max({dom1.lo - x, x - dom1.hi, FloatT(0.0)});
-                        lp = std::max(lp, d1);
+                        BoxRef box = s.prep_->node_box(tree_index)[leaf_id];
+                        if (box.is_invalid_box())
+                            continue;
+
+                        FloatT lp = 0.0;
+                        for (auto &&[feat_id, dom] : box)
+                        {
+                            Domain dom0;
+                            if (static_cast<size_t>(feat_id) <
+                                    s.workspace_.leafiter2.flatbox.size())
+                                dom0 = s.workspace_.leafiter2.flatbox[feat_id];
+                            Domain dom1 = dom.intersect(dom0);
+                            FloatT x = example[feat_id];
+                            FloatT d1 = std::max({dom1.lo - x, x - dom1.hi, FloatT(0.0)});
+                            lp = std::max(lp, d1);
+                        }
+                        min_lp = std::min(min_lp, lp); // pick the leaf with the lowest lp-distance
                     }
-                    min_lp = std::min(min_lp, lp); // pick the leaf with the lowest lp-distance
-                }
+                    return min_lp;
+                });
 
-                lp_h = std::max(min_lp, lp_h);
+                lp_h = std::max({min_lp, lp_state, lp_h});
             }
             return lp_h;
         }
@@ -0,0 +1,476 @@
+/**
+ * \file json.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "json.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace veritas {
+
+    JsonReader::JsonReader(RefillFn refill, size_t buffer_size)
+        : refill_(std::move(refill))
+        , buf_(std::max<size_t>(buffer_size, 16))
+    {}
+
+    JsonReader::JsonReader(std::istream& s, size_t buffer_size)
+        : JsonReader([&s](char *buf, size_t cap) {
+                s.read(buf, static_cast<std::streamsize>(cap));
+                return static_cast<size_t>(s.gcount());
+            }, buffer_size)
+    {}
+
+    bool
+    JsonReader::fill_()
+    {
+        if (!refill_)
+            return false;
+        end_ = refill_(buf_.data(), buf_.size());
+        pos_ = 0;
+        if (end_ == 0)
+            refill_ = nullptr; // end of input
+        return end_ > 0;
+    }
+
+    JsonReader::Token
+    JsonReader::next()
+    {
+        for (;;)
+        {
+            int c = get_();
+            switch (c)
+            {
+            case -1: return Token::END;
+            case '\n': ++line_; break;
+            case ' ': case '\t': case '\r': case ',': case ':': break;
+            case '{': return Token::BEGIN_OBJECT;
+            case '}': return Token::END_OBJECT;
+            case '[': return Token::BEGIN_ARRAY;
+            case ']': return Token::END_ARRAY;
+            case '"':
+                text_.clear();
+                while ((c = get_()) != '"')
+                {
+                    if (c == -1) error("unterminated string");
+                    if (c == '\\')
+                    {
+                        c = get_();
+                        switch (c)
+                        {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        case 'r': c = '\r'; break;
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case -1: error("unterminated string");
+                        default: break; // \" \\ \/, \u kept as is
+                        }
+                    }
+                    text_.push_back(static_cast<char>(c));
+                }
+                return Token::STRING;
+            default:
+                text_.clear();
+                text_.push_back(static_cast<char>(c));
+                for (;;)
+                {
+                    c = peek_();
+                    if (c == -1 || c == ',' || c == '}' || c == ']' || c == ':'
+                            || c == ' ' || c == '\n' || c == '\t' || c == '\r')
+                        break;
+                    text_.push_back(static_cast<char>(get_()));
+                }
+                return Token::VALUE;
+            }
+        }
+    }
+
+    void
+    JsonReader::expect(Token t)
+    {
+        if (next() != t)
+            error("unexpected token");
+    }
+
+    FloatT
+    JsonReader::float_value() const
+    {
+        FloatT v;
+        const char *b = text_.data(), *e = b + text_.size();
+        if (b != e && *b == '+') ++b; // from_chars does not accept '+'
+        auto [ptr, ec] = std::from_chars(b, e, v);
+        if (ec != std::errc() || ptr != e)
+            error("invalid number '" + text_ + "'");
+        return v;
+    }
+
+    int
+    JsonReader::int_value() const
+    {
+        int v;
+        const char *b = text_.data(), *e = b + text_.size();
+        auto [ptr, ec] = std::from_chars(b, e, v);
+        if (ec != std::errc() || ptr != e)
+            error("invalid integer '" + text_ + "'");
+        return v;
+    }
+
+    void
+    JsonReader::error(const std::string& msg) const
+    {
+        throw std::runtime_error("json parse error on line "
+                + std::to_string(line_) + ": " + msg);
+    }
+
+    UbjsonReader::UbjsonReader(RefillFn refill, size_t buffer_size)
+        : refill_(std::move(refill))
+        , buf_(std::max<size_t>(buffer_size, 16))
+    {}
+
+    UbjsonReader::UbjsonReader(std::istream& s, size_t buffer_size)
+        : UbjsonReader([&s](char *buf, size_t cap) {
+                s.read(buf, static_cast<std::streamsize>(cap));
+                return static_cast<size_t>(s.gcount());
+            }, buffer_size)
+    {}
+
+    bool
+    UbjsonReader::fill_()
+    {
+        if (!refill_)
+            return false;
+        end_ = refill_(buf_.data(), buf_.size());
+        pos_ = 0;
+        if (end_ == 0)
+            refill_ = nullptr;
+        return end_ > 0;
+    }
+
+    int
+    UbjsonReader::get_()
+    {
+        if (pos_ == end_ && !fill_())
+            return -1;
+        return static_cast<unsigned char>(buf_[pos_++]);
+    }
+
+    void
+    UbjsonReader::read_(char *dst, size_t n)
+    {
+        while (n > 0)
+        {
+            if (pos_ == end_ && !fill_())
+                error("unexpected end of input");
+            size_t m = std::min(n, end_ - pos_);
+            std::memcpy(dst, &buf_[pos_], m);
+            pos_ += m;
+            dst += m;
+            n -= m;
+        }
+    }
+
+    int64_t
+    UbjsonReader::read_int_(char type)
+    {
+        // big-endian
+        unsigned char b[8];
+        size_t n;
+        switch (type)
+        {
+        case 'i': case 'U': n = 1; break;
+        case 'I': n = 2; break;
+        case 'l': n = 4; break;
+        case 'L': n = 8; break;
+        default: error("expected integer type");
+        }
+        read_(reinterpret_cast<char *>(b), n);
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; ++i)
+            v = (v << 8) | b[i];
+        if (type == 'U')
+            return static_cast<int64_t>(v);
+        // sign extend
+        int shift = static_cast<int>(64 - 8*n);
+        return static_cast<int64_t>(v << shift) >> shift;
+    }
+
+    int64_t
+    UbjsonReader::read_length_()
+    {
+        int64_t n = read_int_(static_cast<char>(get_()));
+        if (n < 0)
+            error("negative length");
+        return n;
+    }
+
+    UbjsonReader::Token
+    UbjsonReader::begin_container_(bool is_object)
+    {
+        Container c {is_object, 0, -1, true};
+        int m = get_();
+        if (m == '$')
+        {
+            c.type = static_cast<char>(get_());
+            if (get_() != '#')
+                error("typed container without count");
+            c.remaining = read_length_();
+        }
+        else if (m == '#')
+        {
+            c.remaining = read_length_();
+        }
+        else if (m != -1)
+        {
+            --pos_; // not an optimized container, put back
+        }
+        stack_.push_back(c);
+        return is_object ? Token::BEGIN_OBJECT : Token::BEGIN_ARRAY;
+    }
+
+    UbjsonReader::Token
+    UbjsonReader::read_value_(char marker)
+    {
+        type_ = marker;
+        switch (marker)
+        {
+        case '{': return begin_container_(true);
+        case '[': return begin_container_(false);
+        case 'Z': text_ = "null"; return Token::VALUE;
+        case 'T': text_ = "true"; return Token::VALUE;
+        case 'F': text_ = "false"; return Token::VALUE;
+        case 'i': case 'U': case 'I': case 'l': case 'L':
+            int_ = read_int_(marker);
+            return Token::VALUE;
+        case 'd': {
+            unsigned char b[4];
+            read_(reinterpret_cast<char *>(b), 4);
+            uint32_t v = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16)
+                | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+            std::memcpy(&float_, &v, 4);
+            return Token::VALUE;
+        }
+        case 'D': {
+            unsigned char b[8];
+            read_(reinterpret_cast<char *>(b), 8);
+            uint64_t v = 0;
+            for (int i = 0; i < 8; ++i)
+                v = (v << 8) | b[i];
+            std::memcpy(&double_, &v, 8);
+            return Token::VALUE;
+        }
+        case 'H': // high-precision number as a string
+        case 'S': {
+            text_.resize(static_cast<size_t>(read_length_()));
+            read_(text_.data(), text_.size());
+            return marker == 'S' ? Token::STRING : Token::VALUE;
+        }
+        case 'C':
+            text_.assign(1, static_cast<char>(get_()));
+            return Token::STRING;
+        default:
+            error(std::string("unknown type marker '") + marker + "'");
+        }
+    }
+
+    UbjsonReader::Token
+    UbjsonReader::next()
+    {
+        if (!stack_.empty())
+        {
+            Container& c = stack_.back();
+            if (c.remaining == 0 && c.expect_key) // end of counted container
+            {
+                bool is_object = c.is_object;
+                stack_.pop_back();
+                return is_object ? Token::END_OBJECT : Token::END_ARRAY;
+            }
+            if (c.is_object && c.expect_key)
+            {
+                int m = 0;
+                if (c.remaining < 0)
+                {
+                    while ((m = get_()) == 'N') {} // no-op
+                    if (m == '}')
+                    {
+                        stack_.pop_back();
+                        return Token::END_OBJECT;
+                    }
+                    if (m == -1)
+                        error("unexpected end of input");
+                    --pos_;
+                }
+                text_.resize(static_cast<size_t>(read_length_()));
+                read_(text_.data(), text_.size());
+                c.expect_key = false;
+                return Token::STRING;
+            }
+        }
+
+        char marker;
+        if (!stack_.empty() && stack_.back().type != 0)
+            marker = stack_.back().type;
+        else
+        {
+            int m;
+            while ((m = get_()) == 'N') {} // no-op
+            if (m == -1)
+            {
+                if (!stack_.empty())
+                    error("unexpected end of input");
+                return Token::END;
+            }
+            marker = static_cast<char>(m);
+            if (!stack_.empty() && stack_.back().remaining < 0
+                    && marker == (stack_.back().is_object ? '}' : ']'))
+            {
+                bool is_object = stack_.back().is_object;
+                stack_.pop_back();
+                return is_object ? Token::END_OBJECT : Token::END_ARRAY;
+            }
+        }
+
+        if (!stack_.empty()) // a slot of the parent is consumed
+        {
+            Container& c = stack_.back();
+            c.expect_key = true;
+            if (c.remaining > 0)
+                --c.remaining;
+        }
+        return read_value_(marker);
+    }
+
+    void
+    UbjsonReader::expect(Token t)
+    {
+        if (next() != t)
+            error("unexpected token");
+    }
+
+    FloatT
+    UbjsonReader::float_value() const
+    {
+        switch (type_)
+        {
+        case 'd': return static_cast<FloatT>(float_);
+        case 'D': return static_cast<FloatT>(double_);
+        case 'i': case 'U': case 'I': case 'l': case 'L':
+            return static_cast<FloatT>(int_);
+        case 'H': {
+            FloatT v;
+            auto [ptr, ec] = std::from_chars(text_.data(), text_.data() + text_.size(), v);
+            if (ec != std::errc() || ptr != text_.data() + text_.size())
+                error("invalid number '" + text_ + "'");
+            return v;
+        }
+        default: error("not a number");
+        }
+    }
+
+    int
+    UbjsonReader::int_value() const
+    {
+        switch (type_)
+        {
+        case 'i': case 'U': case 'I': case 'l': case 'L':
+            if (int_ < std::numeric_limits<int>::min() || int_ > std::numeric_limits<int>::max())
+                error("integer out of range");
+            return static_cast<int>(int_);
+        default: error("not an integer");
+        }
+    }
+
+    void
+    UbjsonReader::error(const std::string& msg) const
+    {
+        throw std::runtime_error("ubjson parse error: " + msg);
+    }
+
+    JsonWriter::JsonWriter(FlushFn flush, size_t buffer_size)
+        : flush_(std::move(flush))
+        , buf_(std::max<size_t>(buffer_size, 64))
+    {}
+
+    JsonWriter::JsonWriter(std::ostream& s, size_t buffer_size)
+        : JsonWriter([&s](const char *data, size_t n) {
+                s.write(data, static_cast<std::streamsize>(n));
+            }, buffer_size)
+    {}
+
+    JsonWriter::~JsonWriter()
+    {
+        try { flush(); }
+        catch (...) {}
+    }
+
+    JsonWriter&
+    JsonWriter::raw(const char *s, size_t n)
+    {
+        while (n > 0)
+        {
+            if (pos_ == buf_.size())
+                flush();
+            size_t m = std::min(n, buf_.size() - pos_);
+            std::memcpy(&buf_[pos_], s, m);
+            pos_ += m;
+            s += m;
+            n -= m;
+        }
+        return *this;
+    }
+
+    JsonWriter&
+    JsonWriter::raw(const char *s)
+    { return raw(s, std::strlen(s)); }
+
+    JsonWriter&
+    JsonWriter::raw(char c)
+    { return raw(&c, 1); }
+
+    JsonWriter&
+    JsonWriter::number(FloatT v)
+    {
+        char *p = reserve_(32);
+        auto [end, ec] = std::to_chars(p, p + 32, v);
+        if (ec != std::errc())
+            throw std::runtime_error("json write error: to_chars");
+        pos_ += static_cast<size_t>(end - p);
+        return *this;
+    }
+
+    JsonWriter&
+    JsonWriter::number(int v)
+    {
+        char *p = reserve_(16);
+        auto [end, ec] = std::to_chars(p, p + 16, v);
+        if (ec != std::errc())
+            throw std::runtime_error("json write error: to_chars");
+        pos_ += static_cast<size_t>(end - p);
+        return *this;
+    }
+
+    JsonWriter&
+    JsonWriter::indent(int depth)
+    {
+        for (int i = 0; i < depth; ++i)
+            raw("  ", 2);
+        return *this;
+    }
+
+    void
+    JsonWriter::flush()
+    {
+        if (pos_ == 0)
+            return;
+        size_t n = pos_;
+        pos_ = 0;
+        flush_(buf_.data(), n);
+    }
+
+} // namespace veritas
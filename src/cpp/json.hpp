@@ -0,0 +1,174 @@
+/**
+ * \file json.hpp
+ *
+ * Buffered JSON reading and writing for the model files. The reader pulls
+ * its input through a refill callback and keeps a fixed-size buffer, so
+ * large and compressed files can be streamed. Floats are written with
+ * `std::to_chars`, the shortest representation that reads back exactly.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_JSON_HPP
+#define VERITAS_JSON_HPP
+
+#include "basics.hpp"
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Pull tokenizer for JSON. Separators (`,` and `:`) are skipped, the
+     * caller knows the structure it expects.
+     */
+    class JsonReader {
+    public:
+        /** Write at most `cap` bytes to `buf`, return the number of bytes
+         * written; 0 at the end of the input. */
+        using RefillFn = std::function<size_t(char *buf, size_t cap)>;
+
+        enum class Token {
+            BEGIN_OBJECT, END_OBJECT,
+            BEGIN_ARRAY, END_ARRAY,
+            STRING,
+            VALUE, /**< number or literal, see JsonReader::text */
+            END,   /**< end of input */
+        };
+
+    private:
+        RefillFn refill_;
+        std::vector<char> buf_;
+        size_t pos_ = 0, end_ = 0;
+        size_t line_ = 1;
+        std::string text_;
+
+        bool fill_();
+        inline int peek_()
+        { return (pos_ < end_ || fill_()) ? static_cast<unsigned char>(buf_[pos_]) : -1; }
+        inline int get_() { int c = peek_(); if (c >= 0) ++pos_; return c; }
+
+    public:
+        explicit JsonReader(RefillFn refill, size_t buffer_size = 1 << 16);
+        /** Read from `s`. Buffers ahead, so the stream position is not
+         * meaningful afterwards. */
+        explicit JsonReader(std::istream& s, size_t buffer_size = 1 << 16);
+
+        /** Read the next token. */
+        Token next();
+        /** Read the next token and throw if it is not `t`. */
+        void expect(Token t);
+
+        /** The contents of the last STRING or VALUE token. */
+        inline const std::string& text() const { return text_; }
+        /** Parse the last VALUE token as a float, exactly. */
+        FloatT float_value() const;
+        /** Parse the last VALUE token as an integer. */
+        int int_value() const;
+
+        /** Throw a parse error mentioning the current line. */
+        [[noreturn]] void error(const std::string& msg) const;
+    }; // JsonReader
+
+    /**
+     * Pull tokenizer for UBJSON (Universal Binary JSON, used by XGBoost's
+     * `.ubj` model files), with the same interface as JsonReader. Object
+     * keys are returned as STRING tokens. Optimized containers (`$` type
+     * and `#` count) are supported.
+     */
+    class UbjsonReader {
+    public:
+        using RefillFn = JsonReader::RefillFn;
+        using Token = JsonReader::Token;
+
+    private:
+        struct Container {
+            bool is_object;
+            char type;          /* element type of a typed container, or 0 */
+            int64_t remaining;  /* number of elements left, or -1 if not counted */
+            bool expect_key;
+        };
+
+        RefillFn refill_;
+        std::vector<char> buf_;
+        size_t pos_ = 0, end_ = 0;
+        std::vector<Container> stack_;
+        std::string text_;
+        char type_ = 0;         /* type marker of the last VALUE */
+        int64_t int_ = 0;
+        double double_ = 0.0;
+        float float_ = 0.0f;
+
+        bool fill_();
+        int get_();
+        void read_(char *dst, size_t n);
+        int64_t read_int_(char type);
+        int64_t read_length_();
+        Token begin_container_(bool is_object);
+        Token read_value_(char marker);
+
+    public:
+        explicit UbjsonReader(RefillFn refill, size_t buffer_size = 1 << 16);
+        explicit UbjsonReader(std::istream& s, size_t buffer_size = 1 << 16);
+
+        Token next();
+        void expect(Token t);
+
+        /** The contents of the last STRING token, or of a high-precision
+         * or literal VALUE. */
+        inline const std::string& text() const { return text_; }
+        FloatT float_value() const;
+        int int_value() const;
+
+        [[noreturn]] void error(const std::string& msg) const;
+    }; // UbjsonReader
+
+    /**
+     * Buffered JSON output. Call JsonWriter::flush when done; the
+     * destructor also flushes, but swallows errors.
+     */
+    class JsonWriter {
+    public:
+        /** Consume `n` bytes of output. */
+        using FlushFn = std::function<void(const char *data, size_t n)>;
+
+    private:
+        FlushFn flush_;
+        std::vector<char> buf_;
+        size_t pos_ = 0;
+
+        inline char *reserve_(size_t n)
+        {
+            if (pos_ + n > buf_.size())
+                flush();
+            return &buf_[pos_];
+        }
+
+    public:
+        explicit JsonWriter(FlushFn flush, size_t buffer_size = 1 << 16);
+        explicit JsonWriter(std::ostream& s, size_t buffer_size = 1 << 16);
+        ~JsonWriter();
+
+        JsonWriter(const JsonWriter&) = delete;
+        JsonWriter& operator=(const JsonWriter&) = delete;
+
+        JsonWriter& raw(const char *s, size_t n);
+        JsonWriter& raw(const char *s);
+        JsonWriter& raw(char c);
+        /** Shortest representation that reads back to the same float. */
+        JsonWriter& number(FloatT v);
+        JsonWriter& number(int v);
+        /** Write 2*`depth` spaces. */
+        JsonWriter& indent(int depth);
+
+        void flush();
+    }; // JsonWriter
+
+} // namespace veritas
+
+#endif // VERITAS_JSON_HPP
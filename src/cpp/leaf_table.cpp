@@ -0,0 +1,162 @@
+/**
+ * \file leaf_table.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "leaf_table.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace veritas {
+
+    namespace inner {
+        // Domains are inclusive: [lo, hi] and [a, b] overlap iff lo <= b
+        // and hi >= a (see Domain::overlaps). Padding leaves have an empty
+        // box (a = inf, b = -inf) and never overlap.
+
+#ifdef VERITAS_X86_SIMD
+        __attribute__((target("avx2")))
+        static void
+        find_overlapping_avx2(const FloatT *lo, const FloatT *hi, size_t stride,
+                const Domain *doms, const size_t *cols, size_t num_cols,
+                const NodeId *ids, size_t num_leafs, std::vector<NodeId>& leaf_ids)
+        {
+            for (size_t l = 0; l < stride; l += 8)
+            {
+                __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (size_t k = 0; k < num_cols; ++k)
+                {
+                    __m256 a = _mm256_loadu_ps(lo + cols[k] * stride + l);
+                    __m256 b = _mm256_loadu_ps(hi + cols[k] * stride + l);
+                    __m256 dlo = _mm256_set1_ps(doms[k].lo);
+                    __m256 dhi = _mm256_set1_ps(doms[k].hi);
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dlo, b, _CMP_LE_OQ));
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dhi, a, _CMP_GE_OQ));
+                }
+                unsigned bits = static_cast<unsigned>(_mm256_movemask_ps(mask));
+                while (bits != 0)
+                {
+                    size_t i = l + static_cast<size_t>(__builtin_ctz(bits));
+                    bits &= bits - 1;
+                    if (i < num_leafs)
+                        leaf_ids.push_back(ids[i]);
+                }
+            }
+        }
+#endif // VERITAS_X86_SIMD
+
+        static void
+        find_overlapping_scalar(const FloatT *lo, const FloatT *hi, size_t stride,
+                const Domain *doms, const size_t *cols, size_t num_cols,
+                const NodeId *ids, size_t num_leafs, std::vector<NodeId>& leaf_ids)
+        {
+            for (size_t l = 0; l < num_leafs; ++l)
+            {
+                bool overlaps = true;
+                for (size_t k = 0; overlaps && k < num_cols; ++k)
+                    overlaps = doms[k].lo <= hi[cols[k] * stride + l]
+                        && doms[k].hi >= lo[cols[k] * stride + l];
+                if (overlaps)
+                    leaf_ids.push_back(ids[l]);
+            }
+        }
+    } // namespace inner
+
+    LeafBoxTable::LeafBoxTable() : isa_(detect_simd_isa()) {}
+
+    LeafBoxTable::LeafBoxTable(const Tree& tree, const std::vector<BoxRef>& node_box)
+        : isa_(detect_simd_isa())
+    {
+        // leaves in LeafIter's order: left subtree first
+        std::vector<NodeId> stack {tree.root().id()};
+        while (!stack.empty())
+        {
+            Tree::ConstRef n = tree[stack.back()];
+            stack.pop_back();
+            if (n.is_internal())
+            {
+                stack.push_back(n.right().id());
+                stack.push_back(n.left().id());
+            }
+            else if (!node_box.at(n.id()).is_invalid_box())
+            {
+                leaf_ids_.push_back(n.id());
+                for (auto &&[feat_id, dom] : node_box[n.id()])
+                    feats_.push_back(feat_id);
+            }
+        }
+        std::sort(feats_.begin(), feats_.end());
+        feats_.erase(std::unique(feats_.begin(), feats_.end()), feats_.end());
+
+        stride_ = (leaf_ids_.size() + 7) / 8 * 8;
+        lo_.assign(feats_.size() * stride_, FLOATT_INF);
+        hi_.assign(feats_.size() * stride_, -FLOATT_INF);
+        for (size_t l = 0; l < leaf_ids_.size(); ++l)
+        {
+            // features not in the leaf's box are unconstrained
+            for (size_t f = 0; f < feats_.size(); ++f)
+            {
+                lo_[f * stride_ + l] = -FLOATT_INF;
+                hi_[f * stride_ + l] = FLOATT_INF;
+            }
+            for (auto &&[feat_id, dom] : node_box[leaf_ids_[l]])
+            {
+                size_t f = std::lower_bound(feats_.begin(), feats_.end(), feat_id)
+                    - feats_.begin();
+                lo_[f * stride_ + l] = dom.lo;
+                hi_[f * stride_ + l] = dom.hi;
+            }
+        }
+    }
+
+    void
+    LeafBoxTable::set_simd_isa(SimdIsa isa)
+    {
+        if (!cpu_supports(isa))
+            throw std::runtime_error("SIMD instruction set not supported by CPU");
+        isa_ = isa;
+    }
+
+    bool
+    LeafBoxTable::find_overlapping(const std::vector<Domain>& flatbox,
+            std::vector<NodeId>& leaf_ids) const
+    {
+        // only the columns of the features constrained by `flatbox`
+        thread_local std::vector<Domain> doms;
+        thread_local std::vector<size_t> cols;
+        doms.clear();
+        cols.clear();
+        for (size_t f = 0; f < feats_.size(); ++f)
+        {
+            FeatId feat_id = feats_[f];
+            if (static_cast<size_t>(feat_id) < flatbox.size()
+                    && !flatbox[feat_id].is_everything())
+            {
+                doms.push_back(flatbox[feat_id]);
+                cols.push_back(f);
+            }
+        }
+
+        // a tight box reaches few leaves, and LeafIter only visits those
+        if (cols.size() > MAX_CONSTRAINED_FEATS)
+            return false;
+
+#ifdef VERITAS_X86_SIMD
+        if (isa_ != SimdIsa::SCALAR)
+        {
+            inner::find_overlapping_avx2(lo_.data(), hi_.data(), stride_,
+                    doms.data(), cols.data(), cols.size(),
+                    leaf_ids_.data(), leaf_ids_.size(), leaf_ids);
+            return true;
+        }
+#endif
+        inner::find_overlapping_scalar(lo_.data(), hi_.data(), stride_,
+                doms.data(), cols.data(), cols.size(),
+                leaf_ids_.data(), leaf_ids_.size(), leaf_ids);
+        return true;
+    }
+
+} // namespace veritas
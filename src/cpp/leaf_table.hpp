@@ -0,0 +1,72 @@
+/**
+ * \file leaf_table.hpp
+ *
+ * Struct-of-arrays tables of the leaf boxes of a tree, for testing a box
+ * against all leaves at once.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_LEAF_TABLE_HPP
+#define VERITAS_LEAF_TABLE_HPP
+
+#include "tree.hpp"
+#include "simd.hpp"
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * The boxes of the leaves of one tree in a `[feature x leaf]` table of
+     * lower and upper bounds, over the features the boxes use.
+     *
+     * LeafBoxTable::find_overlapping compares a box against all leaves with
+     * a vectorized kernel (8 leaves per AVX2 compare), which for wide trees
+     * is cheaper than the branchy traversal of LeafIter. Leaves are stored
+     * in LeafIter's order (left first), so both produce the same sequence.
+     */
+    class LeafBoxTable {
+        std::vector<FeatId> feats_;
+        std::vector<NodeId> leaf_ids_;
+        size_t stride_ = 0; // number of leaves, padded to a multiple of 8
+        std::vector<FloatT> lo_; // lo_[f * stride_ + l]
+        std::vector<FloatT> hi_;
+        SimdIsa isa_;
+
+    public:
+        /** An empty table. */
+        LeafBoxTable();
+
+        /**
+         * Table of the leaves of `tree` with their boxes in `node_box`
+         * (indexed by NodeId). Leaves with an invalid box are left out.
+         */
+        LeafBoxTable(const Tree& tree, const std::vector<BoxRef>& node_box);
+
+        inline size_t num_leafs() const { return leaf_ids_.size(); }
+        inline size_t num_feats() const { return feats_.size(); }
+
+        SimdIsa simd_isa() const { return isa_; }
+        /** Throws if the CPU does not support `isa`. */
+        void set_simd_isa(SimdIsa isa);
+
+        /** Above this many constrained features, find_overlapping declines:
+         * the box is tight and a LeafIter traversal is cheaper. */
+        static constexpr size_t MAX_CONSTRAINED_FEATS = 16;
+
+        /**
+         * Append the ids of the leaves whose box overlaps with `flatbox`
+         * (indexed by FeatId, missing features are unconstrained) to
+         * `leaf_ids`, in LeafIter's order. Returns false without touching
+         * `leaf_ids` when `flatbox` constrains more than
+         * MAX_CONSTRAINED_FEATS of the table's features.
+         */
+        bool find_overlapping(const std::vector<Domain>& flatbox,
+                std::vector<NodeId>& leaf_ids) const;
+    }; // class LeafBoxTable
+
+} // namespace veritas
+
+#endif // VERITAS_LEAF_TABLE_HPP
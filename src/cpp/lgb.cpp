@@ -0,0 +1,215 @@
+/**
+ * \file lgb.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "lgb.hpp"
+#include <charconv>
+#include <fstream>
+#include <stack>
+#include <stdexcept>
+
+namespace veritas {
+
+    namespace inner {
+
+        /** The `key=value` arrays of a `Tree=` block. */
+        struct LgbTree {
+            int num_leaves = -1;
+            bool is_linear = false;
+            std::vector<int> split_feature;
+            std::vector<double> threshold;
+            std::vector<int> decision_type;
+            std::vector<int> left_child;
+            std::vector<int> right_child;
+            std::vector<double> leaf_value;
+        };
+
+        template <typename T>
+        static T
+        parse_number(const char *begin, const char *end)
+        {
+            T value;
+            auto [ptr, ec] = std::from_chars(begin, end, value);
+            if (ec != std::errc() || ptr != end)
+                throw std::runtime_error("lgb: invalid number '"
+                        + std::string(begin, end) + "'");
+            return value;
+        }
+
+        /** Parse a space separated list of numbers. */
+        template <typename T>
+        static void
+        parse_array(const std::string& value, std::vector<T>& out)
+        {
+            out.clear();
+            const char *p = value.data(), *end = p + value.size();
+            while (p != end)
+            {
+                const char *q = p;
+                while (q != end && *q != ' ') ++q;
+                if (q != p)
+                    out.push_back(parse_number<T>(p, q));
+                p = (q == end) ? q : q + 1;
+            }
+        }
+
+        /** Child references: `>= 0` is an internal node, `~leaf` otherwise. */
+        static Tree
+        build_lgb_tree(const LgbTree& t)
+        {
+            if (t.is_linear)
+                throw std::runtime_error("lgb: linear trees not supported");
+            if (t.num_leaves < 1 || t.leaf_value.size() != static_cast<size_t>(t.num_leaves))
+                throw std::runtime_error("lgb: invalid num_leaves or leaf_value");
+
+            Tree tree;
+            if (t.num_leaves == 1)
+            {
+                tree.root().set_leaf_value(static_cast<FloatT>(t.leaf_value[0]));
+                return tree;
+            }
+
+            size_t num_internal = static_cast<size_t>(t.num_leaves) - 1;
+            if (t.split_feature.size() != num_internal
+                    || t.threshold.size() != num_internal
+                    || t.decision_type.size() != num_internal
+                    || t.left_child.size() != num_internal
+                    || t.right_child.size() != num_internal)
+                throw std::runtime_error("lgb: inconsistent tree arrays");
+
+            std::stack<std::pair<int, Tree::MutRef>,
+                std::vector<std::pair<int, Tree::MutRef>>> stack;
+            stack.push({0, tree.root()});
+            size_t count = 0;
+            while (!stack.empty())
+            {
+                auto [child, n] = stack.top();
+                stack.pop();
+                if (++count > 2 * num_internal + 1)
+                    throw std::runtime_error("lgb: invalid tree structure");
+
+                if (child < 0)
+                {
+                    size_t leaf = static_cast<size_t>(~child);
+                    if (leaf >= t.leaf_value.size())
+                        throw std::runtime_error("lgb: invalid leaf index");
+                    n.set_leaf_value(static_cast<FloatT>(t.leaf_value[leaf]));
+                    continue;
+                }
+
+                size_t i = static_cast<size_t>(child);
+                if (i >= num_internal)
+                    throw std::runtime_error("lgb: invalid node index");
+                if (t.decision_type[i] & 1)
+                    throw std::runtime_error("lgb: categorical splits not supported");
+
+                n.split({t.split_feature[i], le_split_value(t.threshold[i])});
+                stack.push({t.right_child[i], n.right()});
+                stack.push({t.left_child[i], n.left()});
+            }
+            return tree;
+        }
+
+    } // namespace inner
+
+    std::vector<AddTree>
+    addtrees_from_lgb_text(std::istream& strm)
+    {
+        int num_tree_per_iteration = 1;
+        bool average_output = false;
+        bool seen_end = false;
+        std::vector<Tree> trees;
+        inner::LgbTree current;
+        bool in_tree = false;
+
+        auto finish_tree = [&]() {
+            if (in_tree)
+                trees.push_back(inner::build_lgb_tree(current));
+            current = inner::LgbTree();
+        };
+
+        std::string line, value;
+        while (std::getline(strm, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
+                continue;
+            if (line == "end of trees")
+            {
+                seen_end = true;
+                break; // feature importances and parameters follow
+            }
+            if (line.compare(0, 5, "Tree=") == 0)
+            {
+                finish_tree();
+                in_tree = true;
+                continue;
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos)
+            {
+                if (line == "average_output")
+                    average_output = true;
+                continue;
+            }
+            std::string key = line.substr(0, eq);
+            value.assign(line, eq + 1);
+
+            if (!in_tree)
+            {
+                if (key == "num_tree_per_iteration")
+                    num_tree_per_iteration = std::stoi(value);
+                continue;
+            }
+
+            if (key == "num_leaves") current.num_leaves = std::stoi(value);
+            else if (key == "is_linear") current.is_linear = (value != "0");
+            else if (key == "split_feature") inner::parse_array(value, current.split_feature);
+            else if (key == "threshold") inner::parse_array(value, current.threshold);
+            else if (key == "decision_type") inner::parse_array(value, current.decision_type);
+            else if (key == "left_child") inner::parse_array(value, current.left_child);
+            else if (key == "right_child") inner::parse_array(value, current.right_child);
+            else if (key == "leaf_value") inner::parse_array(value, current.leaf_value);
+        }
+        finish_tree();
+
+        if (!seen_end)
+            throw std::runtime_error("lgb: missing 'end of trees'");
+        if (num_tree_per_iteration < 1)
+            throw std::runtime_error("lgb: invalid num_tree_per_iteration");
+
+        size_t num_groups = static_cast<size_t>(num_tree_per_iteration);
+        std::vector<AddTree> ats(num_groups);
+        for (size_t i = 0; i < trees.size(); ++i)
+            ats[i % num_groups].add_tree(std::move(trees[i]));
+
+        // random forest mode: the output is the mean of the trees
+        if (average_output)
+            for (AddTree& at : ats)
+                if (at.size() > 0)
+                {
+                    FloatT scale = 1.0f / static_cast<FloatT>(at.size());
+                    for (size_t t = 0; t < at.size(); ++t)
+                        for (NodeId id : at[t].get_leaf_ids())
+                            at[t][id].set_leaf_value(at[t][id].leaf_value() * scale);
+                }
+
+        return ats;
+    }
+
+    std::vector<AddTree>
+    addtrees_from_lgb_file(const std::string& path)
+    {
+        std::ifstream f(path);
+        if (!f)
+            throw std::runtime_error("cannot open " + path);
+        return addtrees_from_lgb_text(f);
+    }
+
+} // namespace veritas
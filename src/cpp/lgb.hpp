@@ -0,0 +1,43 @@
+/**
+ * \file lgb.hpp
+ *
+ * Import LightGBM models in LightGBM's text format (`Booster.save_model`,
+ * `Booster.model_to_string`), without going through Python.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_LGB_HPP
+#define VERITAS_LGB_HPP
+
+#include "tree.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Read a LightGBM text model. Returns one AddTree per output group:
+     * `num_tree_per_iteration` AddTrees, tree `i` belongs to group `i %
+     * num_tree_per_iteration`. The base_score of the AddTrees is zero,
+     * LightGBM folds the initial score into the first trees.
+     *
+     * LightGBM sends an instance left if `x <= threshold`, with a double
+     * threshold. The split value is the smallest float `s` such that `x < s`
+     * for exactly those floats, so the split decisions are exact.
+     *
+     * Missing value handling (`default_left`, zero-as-missing) is ignored;
+     * veritas always sends NaN right. Categorical splits and linear trees
+     * are not supported.
+     */
+    std::vector<AddTree> addtrees_from_lgb_text(std::istream& strm);
+
+    /** Like ::addtrees_from_lgb_text, but read from a file. */
+    std::vector<AddTree> addtrees_from_lgb_file(const std::string& path);
+
+} // namespace veritas
+
+#endif // VERITAS_LGB_HPP
@@ -0,0 +1,125 @@
+/**
+ * \file native.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "native.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+namespace veritas {
+
+    namespace inner {
+        static std::string
+        shell_quote(const std::string& s)
+        {
+            std::string q = "'";
+            for (char c : s)
+            {
+                if (c == '\'') q += "'\\''";
+                else           q += c;
+            }
+            return q + "'";
+        }
+    } // namespace inner
+
+#ifndef _WIN32
+    NativePredictor::NativePredictor(const std::string& so_path)
+        : handle_(nullptr), eval_(nullptr), eval_batch_(nullptr), num_trees_(0)
+    {
+        handle_ = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle_ == nullptr)
+            throw std::runtime_error(std::string("dlopen failed: ") + dlerror());
+
+        // object to function pointer casts are conditionally supported,
+        // but guaranteed by POSIX
+        eval_ = reinterpret_cast<EvalFn>(dlsym(handle_, "veritas_eval"));
+        eval_batch_ = reinterpret_cast<EvalBatchFn>(dlsym(handle_, "veritas_eval_batch"));
+        auto num_trees = reinterpret_cast<NumTreesFn>(dlsym(handle_, "veritas_num_trees"));
+        if (!eval_ || !eval_batch_ || !num_trees)
+        {
+            dlclose(handle_);
+            throw std::runtime_error("not a veritas shared object: " + so_path);
+        }
+        num_trees_ = num_trees();
+    }
+
+    NativePredictor::~NativePredictor()
+    {
+        if (handle_)
+            dlclose(handle_);
+    }
+#else
+    NativePredictor::NativePredictor(const std::string&)
+        : handle_(nullptr), eval_(nullptr), eval_batch_(nullptr), num_trees_(0)
+    {
+        throw std::runtime_error("NativePredictor is not supported on Windows");
+    }
+
+    NativePredictor::~NativePredictor() {}
+#endif
+
+    NativePredictor::NativePredictor(NativePredictor&& o)
+        : handle_(o.handle_)
+        , eval_(o.eval_)
+        , eval_batch_(o.eval_batch_)
+        , num_trees_(o.num_trees_)
+    {
+        o.handle_ = nullptr;
+        o.eval_ = nullptr;
+        o.eval_batch_ = nullptr;
+        o.num_trees_ = 0;
+    }
+
+    NativePredictor&
+    NativePredictor::operator=(NativePredictor&& o)
+    {
+        // tmp takes o's library and releases ours when it goes out of scope
+        NativePredictor tmp(std::move(o));
+        std::swap(handle_, tmp.handle_);
+        std::swap(eval_, tmp.eval_);
+        std::swap(eval_batch_, tmp.eval_batch_);
+        std::swap(num_trees_, tmp.num_trees_);
+        return *this;
+    }
+
+    NativePredictor
+    NativePredictor::build(const AddTree& at, const std::string& so_path,
+            const std::string& compiler, const std::string& flags)
+    {
+        std::string source_path = so_path + ".cpp";
+        at.compile_to_source(source_path);
+
+        std::string cmd = compiler + " " + flags + " -std=c++17 -shared -fPIC -o "
+            + inner::shell_quote(so_path) + " " + inner::shell_quote(source_path);
+        if (std::system(cmd.c_str()) != 0)
+            throw std::runtime_error("native compilation failed: " + cmd);
+
+        return NativePredictor(so_path);
+    }
+
+    bool
+    NativePredictor::is_bit_exact(const AddTree& at, const data& d) const
+    {
+        if (at.size() != size())
+            return false;
+        for (size_t i = 0; i < d.num_rows; ++i)
+        {
+            FloatT expected = at.eval(d.row(i));
+            FloatT actual = eval(d.row(i));
+            if (std::memcmp(&expected, &actual, sizeof(FloatT)) != 0)
+                return false;
+        }
+        return true;
+    }
+
+} // namespace veritas
@@ -0,0 +1,89 @@
+/**
+ * \file native.hpp
+ *
+ * Build the source emitted by AddTree::compile_to_source into a shared
+ * object with the system C++ compiler, and load it as a scoring function.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_NATIVE_HPP
+#define VERITAS_NATIVE_HPP
+
+#include "tree.hpp"
+#include <stdexcept>
+#include <string>
+
+namespace veritas {
+
+    /**
+     * A natively compiled AddTree loaded from a shared object.
+     *
+     * Only supported on POSIX systems (uses `dlopen`).
+     */
+    class NativePredictor {
+        using EvalFn = float (*)(const float *, size_t);
+        using EvalBatchFn = void (*)(const float *, size_t, size_t, size_t, float *);
+        using NumTreesFn = size_t (*)();
+
+        void *handle_;
+        EvalFn eval_;
+        EvalBatchFn eval_batch_;
+        size_t num_trees_;
+
+    public:
+        /** Load a shared object built from AddTree::compile_to_source. */
+        explicit NativePredictor(const std::string& so_path);
+
+        /**
+         * Write the source of `at` to `so_path + ".cpp"`, compile it into
+         * a shared object at `so_path` and load it.
+         *
+         * `compiler` and `flags` are passed to the shell as is. Throws when
+         * compilation fails.
+         */
+        static NativePredictor build(const AddTree& at, const std::string& so_path,
+                const std::string& compiler = "c++",
+                const std::string& flags = "-O2");
+
+        NativePredictor(NativePredictor&& o);
+        NativePredictor& operator=(NativePredictor&& o);
+        NativePredictor(const NativePredictor&) = delete;
+        NativePredictor& operator=(const NativePredictor&) = delete;
+        ~NativePredictor();
+
+        /** Number of trees of the compiled ensemble. */
+        inline size_t size() const { return num_trees_; }
+
+        /** Evaluate the ensemble on the first row of `row`. */
+        inline FloatT eval(const data& row) const
+        {
+            check_loaded_();
+            return eval_(row.ptr, row.stride_col);
+        }
+
+        /** Evaluate the ensemble on all rows of `d`, write to `out`. */
+        inline void eval(const data& d, FloatT *out) const
+        {
+            check_loaded_();
+            eval_batch_(d.ptr, d.num_rows, d.stride_row, d.stride_col, out);
+        }
+
+        /** Is the output on all rows of `d` bitwise identical to
+         * AddTree::eval? */
+        bool is_bit_exact(const AddTree& at, const data& d) const;
+
+    private:
+        /** Throw when this object was moved from. */
+        inline void check_loaded_() const
+        {
+            if (handle_ == nullptr)
+                throw std::runtime_error("NativePredictor has no loaded shared object");
+        }
+    }; // NativePredictor
+
+} // namespace veritas
+
+#endif // VERITAS_NATIVE_HPP
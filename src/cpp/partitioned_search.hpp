@@ -0,0 +1,289 @@
+/**
+ * \file partitioned_search.hpp
+ *
+ * Run independent searches on disjoint parts of the input space.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_PARTITIONED_SEARCH_HPP
+#define VERITAS_PARTITIONED_SEARCH_HPP
+
+#include "search.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Split the input space into `num_parts` disjoint boxes.
+     *
+     * Boxes are bisected breadth-first. A box is split on the feature with
+     * the most split values of `at` (see AddTree::get_splits) inside its
+     * domain, at the median of those values. Boxes without such a feature
+     * are not split further, so fewer than `num_parts` boxes may be returned.
+     */
+    inline std::vector<Box>
+    partition_input_space(const AddTree& at, size_t num_parts)
+    {
+        AddTree::SplitMapT splits = at.get_splits();
+        std::vector<Box> boxes {Box()};
+
+        for (size_t i = 0; boxes.size() < num_parts && i < boxes.size(); )
+        {
+            Box box = boxes[i];
+            auto domain_of = [&box](FeatId feat_id) {
+                for (const DomainPair& p : box)
+                    if (p.feat_id == feat_id)
+                        return p.domain;
+                return Domain();
+            };
+
+            FeatId best_feat_id = -1;
+            FloatT best_value = 0.0;
+            size_t best_count = 0;
+            for (auto &&[feat_id, values] : splits)
+            {
+                Domain dom = domain_of(feat_id);
+                auto begin = std::upper_bound(values.begin(), values.end(), dom.lo);
+                auto end = std::lower_bound(begin, values.end(), dom.hi);
+                size_t count = end - begin; // split values strictly inside dom
+                if (count > best_count || (count == best_count && count > 0
+                            && feat_id < best_feat_id))
+                {
+                    best_feat_id = feat_id;
+                    best_value = *(begin + count / 2);
+                    best_count = count;
+                }
+            }
+
+            if (best_count == 0) // nothing to split on in this box
+            {
+                ++i;
+                continue;
+            }
+
+            auto &&[left, right] = domain_of(best_feat_id).split(best_value);
+            Box right_box = box;
+            refine_box(box, best_feat_id, left);
+            refine_box(right_box, best_feat_id, right);
+
+            // the new boxes go to the back: split all boxes of a level first
+            boxes.erase(boxes.begin() + i);
+            boxes.push_back(std::move(box));
+            boxes.push_back(std::move(right_box));
+        }
+
+        return boxes;
+    }
+
+    /**
+     * One Search per part of the input space (see partition_input_space),
+     * stepped in parallel on a thread pool.
+     *
+     * The bounds of the parts are merged into global bounds: the lower bound
+     * is the best solution of any part, the upper bound the best upper bound
+     * of any part. A part whose upper bound cannot beat the global lower bound
+     * is not stepped anymore.
+     */
+    template <typename Heuristic>
+    class PartitionedSearch {
+        std::vector<Box> boxes_;
+        std::vector<std::unique_ptr<Search<Heuristic>>> parts_;
+        std::vector<StopReason> stop_reasons_;
+        ThreadPool pool_;
+
+        const Heuristic& heuristic_() const { return parts_[0]->heuristic; }
+
+        /** `a` is a better score than `b`, with missing (NaN) scores last */
+        bool cmp_(FloatT a, FloatT b) const
+        {
+            if (std::isnan(b)) return !std::isnan(a);
+            if (std::isnan(a)) return false;
+            return heuristic_().cmp_open_score(a, b);
+        }
+
+    public:
+        /**
+         * Split the input space of `at` into `num_parts` boxes and construct
+         * a Search for each with the heuristic arguments `heur_args`.
+         * `num_threads == 0` uses all cores. The parts share one
+         * PreparedEnsemble and are restricted to their box with
+         * Search::restrict_to_box.
+         */
+        template <typename... HeurArgs>
+        PartitionedSearch(const AddTree& at, size_t num_parts,
+                size_t num_threads, HeurArgs... heur_args)
+            : boxes_(partition_input_space(at, std::max<size_t>(1, num_parts)))
+            , pool_(num_threads)
+        {
+            auto prep = PreparedEnsemble::create(at);
+            for (const Box& box : boxes_)
+            {
+                parts_.emplace_back(new Search<Heuristic>(prep, heur_args...));
+                parts_.back()->restrict_to_box(BoxRef(box));
+                stop_reasons_.push_back(StopReason::NONE);
+            }
+        }
+
+        size_t num_parts() const { return parts_.size(); }
+        const Box& part_box(size_t part) const { return boxes_.at(part); }
+
+        /** The search of a part, e.g., to change its settings. */
+        Search<Heuristic>& part(size_t part) { return *parts_.at(part); }
+        const Search<Heuristic>& part(size_t part) const { return *parts_.at(part); }
+
+        /** The part is still stepped by `steps`. */
+        bool is_active(size_t part) const
+        { return stop_reasons_.at(part) == StopReason::NONE; }
+
+        /** Divide `bytes` evenly over the parts. */
+        void set_mem_capacity(size_t bytes)
+        {
+            for (auto& s : parts_)
+                s->set_mem_capacity(bytes / parts_.size());
+        }
+
+        /**
+         * Do `num_steps` steps in each active part, then deactivate the parts
+         * that stopped, and those that cannot beat the global lower bound.
+         * When no part is active and optimality is not proven, return the
+         * stop reason of a part that did not finish, or NO_MORE_OPEN.
+         */
+        StopReason steps(size_t num_steps)
+        {
+            std::vector<size_t> active;
+            for (size_t i = 0; i < parts_.size(); ++i)
+                if (is_active(i))
+                    active.push_back(i);
+
+            pool_.parallel_for(0, active.size(), 1, [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; ++i)
+                    stop_reasons_[active[i]] = parts_[active[i]]->steps(num_steps);
+            });
+
+            FloatT lo = std::get<0>(current_bounds());
+            for (size_t i : active)
+            {
+                FloatT part_up = std::get<1>(parts_[i]->current_bounds());
+                if (is_active(i) && !std::isnan(lo) && cmp_(lo, part_up))
+                    stop_reasons_[i] = StopReason::UPPER_LT;
+            }
+
+            if (is_optimal())
+                return StopReason::OPTIMAL;
+            for (size_t i = 0; i < parts_.size(); ++i)
+                if (is_active(i))
+                    return StopReason::NONE;
+
+            // all parts stopped: report a stop condition that ended a part
+            // before it was done, if any
+            for (StopReason r : stop_reasons_)
+                if (r != StopReason::NO_MORE_OPEN && r != StopReason::OPTIMAL
+                        && r != StopReason::UPPER_LT)
+                    return r;
+            return StopReason::NO_MORE_OPEN;
+        }
+
+        StopReason step_for(double num_seconds, size_t num_steps)
+        {
+            double start = time_since_start();
+            StopReason stop_reason = StopReason::NONE;
+
+            while (stop_reason == StopReason::NONE)
+            {
+                stop_reason = steps(num_steps);
+                double dur = time_since_start() - start;
+                if (dur >= num_seconds)
+                    break;
+            }
+
+            return stop_reason;
+        }
+
+        /** Seconds since the construction of the first part's search */
+        double time_since_start() const { return parts_[0]->time_since_start(); }
+
+        /**
+         * Global lower, upper bound and top of open, merged from the parts.
+         * Like Search::current_bounds, but the lower bound is NaN when no
+         * part has a solution yet.
+         */
+        std::tuple<FloatT, FloatT, FloatT> current_bounds() const
+        {
+            FloatT nan = std::numeric_limits<FloatT>::quiet_NaN();
+            FloatT lo = nan, up = nan, top = nan;
+            for (const auto& s : parts_)
+            {
+                auto &&[part_lo, part_up, part_top] = s->current_bounds();
+                if (s->num_solutions() > 0 && cmp_(part_lo, lo))
+                    lo = part_lo;
+                if (s->num_open() > 0)
+                {
+                    if (cmp_(part_top, top)) top = part_top;
+                    if (cmp_(part_up, up)) up = part_up;
+                }
+            }
+            if (!std::isnan(lo) && (std::isnan(up) || up < lo))
+                up = lo; // as in Search::current_bounds
+            return {lo, up, top};
+        }
+
+        bool is_optimal() const
+        {
+            auto &&[lo, up, top] = current_bounds();
+            return !std::isnan(lo) && lo == up;
+        }
+
+        size_t num_solutions() const
+        {
+            size_t n = 0;
+            for (const auto& s : parts_)
+                n += s->num_solutions();
+            return n;
+        }
+
+        size_t num_open() const
+        {
+            size_t n = 0;
+            for (const auto& s : parts_)
+                n += s->num_open();
+            return n;
+        }
+
+        /** The part with the best solution, or -1 if there are no solutions */
+        int best_part() const
+        {
+            int best = -1;
+            FloatT best_lo = std::numeric_limits<FloatT>::quiet_NaN();
+            for (size_t i = 0; i < parts_.size(); ++i)
+            {
+                if (parts_[i]->num_solutions() == 0)
+                    continue;
+                FloatT lo = std::get<0>(parts_[i]->current_bounds());
+                if (cmp_(lo, best_lo))
+                {
+                    best = static_cast<int>(i);
+                    best_lo = lo;
+                }
+            }
+            return best;
+        }
+
+        /** The best solution of all parts. */
+        const Solution& get_best_solution() const
+        {
+            int best = best_part();
+            if (best == -1)
+                throw std::runtime_error("no solutions");
+            return parts_[best]->get_solution(0);
+        }
+    }; // class PartitionedSearch
+
+} // namespace veritas
+
+#endif // VERITAS_PARTITIONED_SEARCH_HPP
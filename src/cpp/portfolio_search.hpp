@@ -0,0 +1,292 @@
+/**
+ * \file portfolio_search.hpp
+ *
+ * Race differently configured searches on the same ensemble.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_PORTFOLIO_SEARCH_HPP
+#define VERITAS_PORTFOLIO_SEARCH_HPP
+
+#include "search.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace veritas {
+
+    /** Order of the trees in a PortfolioSearch configuration. The search
+     * adds the trees to a state's box in this order. */
+    enum class TreeOrder {
+        AS_IS,
+        REVERSED,
+        LEAF_VALUE_VARIANCE, /**< Largest Tree::leaf_value_variance first */
+    };
+
+    /** Settings of one Search in a PortfolioSearch */
+    struct PortfolioConfig {
+        FloatT eps = 0.95;
+        bool auto_eps = true;
+        size_t max_focal_size = 1000;
+        TreeOrder tree_order = TreeOrder::AS_IS;
+    };
+
+    /**
+     * Several Search configurations race on separate threads over the same
+     * ensemble.
+     *
+     * The configurations share the best solution score and their upper
+     * bounds: the best solution of one configuration together with the upper
+     * bound of another can prove optimality, which stops all of them.
+     *
+     * Between chunks of steps, maximizing configurations raise their
+     * Search::stop_when_upper_less_than to the best solution score of all
+     * configurations, so the states that cannot beat it are not created.
+     */
+    template <typename Heuristic>
+    class PortfolioSearch {
+        std::vector<PortfolioConfig> configs_;
+        std::vector<std::unique_ptr<Search<Heuristic>>> searches_;
+        std::vector<StopReason> stop_reasons_;
+        ThreadPool pool_;
+
+        /** Best solution score and the top of open of each configuration
+         * (NaN when unknown) */
+        std::atomic<FloatT> best_;
+        std::unique_ptr<std::atomic<FloatT>[]> tops_;
+        std::atomic<bool> stop_{false};
+
+        const Heuristic& heuristic_() const { return searches_[0]->heuristic; }
+
+        static AddTree order_trees_(const AddTree& at, TreeOrder order)
+        {
+            switch (order) {
+            case TreeOrder::REVERSED: {
+                AddTree rev;
+                rev.base_score = at.base_score;
+                for (size_t i = at.size(); i > 0; --i)
+                    rev.add_tree(at[i-1]);
+                return rev;
+            }
+            case TreeOrder::LEAF_VALUE_VARIANCE: {
+                std::vector<std::pair<FloatT, size_t>> order;
+                for (size_t i = 0; i < at.size(); ++i)
+                    order.push_back({at[i].leaf_value_variance(), i});
+                std::stable_sort(order.begin(), order.end(),
+                        [](const auto& a, const auto& b) { return a.first > b.first; });
+                AddTree sorted;
+                sorted.base_score = at.base_score;
+                for (auto&& [var, i] : order)
+                    sorted.add_tree(at[i]);
+                return sorted;
+            }
+            default:
+                return at;
+            }
+        }
+
+        /** Only maximizing heuristics reject states on
+         * Search::stop_when_upper_less_than. */
+        static constexpr bool shares_incumbent_ =
+            std::is_base_of_v<MaxHeuristic, Heuristic>;
+
+        /** Let configuration `i` prune with the best solution of all. */
+        void share_incumbent_(size_t i)
+        {
+            FloatT best = best_.load();
+            Search<Heuristic>& s = *searches_[i];
+            if (shares_incumbent_ && !std::isnan(best)
+                    && best > s.stop_when_upper_less_than)
+                s.stop_when_upper_less_than = best;
+        }
+
+        /** Publish the bounds of configuration `i`, and stop all when they
+         * prove optimality. */
+        void publish_(size_t i)
+        {
+            const Search<Heuristic>& s = *searches_[i];
+            FloatT own = s.num_solutions() > 0
+                ? std::get<0>(s.current_bounds())
+                : std::numeric_limits<FloatT>::quiet_NaN();
+            if (!std::isnan(own))
+            {
+                FloatT best = best_.load();
+                while ((std::isnan(best) || heuristic_().cmp_open_score(own, best))
+                        && !best_.compare_exchange_weak(best, own)) {}
+            }
+            if (s.num_open() > 0)
+                tops_[i] = std::get<2>(s.current_bounds());
+            else
+            {
+                // exhausted: no output above its best solution, or above
+                // the incumbent it pruned with
+                FloatT top = own;
+                if (shares_incumbent_ && s.stop_when_upper_less_than > -FLOATT_INF
+                        && (std::isnan(top) || s.stop_when_upper_less_than > top))
+                    top = s.stop_when_upper_less_than;
+                if (!std::isnan(top))
+                    tops_[i] = top;
+            }
+            if (is_optimal())
+                stop_ = true;
+        }
+
+    public:
+        /**
+         * A Search for each configuration in `configs`, constructed with the
+         * heuristic arguments `heur_args`, each on its own thread.
+         * Configurations with the same tree order share a PreparedEnsemble.
+         */
+        template <typename... HeurArgs>
+        PortfolioSearch(const AddTree& at, std::vector<PortfolioConfig> configs,
+                HeurArgs... heur_args)
+            : configs_(std::move(configs))
+            , pool_(configs_.size())
+            , best_(std::numeric_limits<FloatT>::quiet_NaN())
+            , tops_(new std::atomic<FloatT>[configs_.size()])
+        {
+            if (configs_.empty())
+                throw std::runtime_error("PortfolioSearch: no configurations");
+            std::map<TreeOrder, std::shared_ptr<const PreparedEnsemble>> preps;
+            for (size_t i = 0; i < configs_.size(); ++i)
+            {
+                const PortfolioConfig& c = configs_[i];
+                auto& prep = preps[c.tree_order];
+                if (!prep)
+                    prep = PreparedEnsemble::create(order_trees_(at, c.tree_order));
+                searches_.emplace_back(new Search<Heuristic>(prep, heur_args...));
+                Search<Heuristic>& s = *searches_.back();
+                s.auto_eps = c.auto_eps;
+                s.eps = c.eps;
+                s.max_focal_size = c.max_focal_size;
+                stop_reasons_.push_back(StopReason::NONE);
+                tops_[i] = std::numeric_limits<FloatT>::quiet_NaN();
+            }
+        }
+
+        /** A spread of eps schedules, focal sizes and tree orders. */
+        static std::vector<PortfolioConfig> default_configs()
+        {
+            return {
+                {0.95, true, 1000, TreeOrder::AS_IS},
+                {0.05, false, 10000, TreeOrder::AS_IS},
+                {1.0, false, 1000, TreeOrder::LEAF_VALUE_VARIANCE},
+                {0.5, true, 100, TreeOrder::REVERSED},
+            };
+        }
+
+        size_t num_configs() const { return configs_.size(); }
+        const PortfolioConfig& config(size_t i) const { return configs_.at(i); }
+
+        /** The search of configuration `i`, e.g., to change its settings. */
+        Search<Heuristic>& search(size_t i) { return *searches_.at(i); }
+        const Search<Heuristic>& search(size_t i) const { return *searches_.at(i); }
+
+        /** Configuration `i` is still racing. */
+        bool is_active(size_t i) const
+        { return stop_reasons_.at(i) == StopReason::NONE; }
+
+        /**
+         * Race the configurations for `num_seconds`, each doing `num_steps`
+         * steps between exchanging bounds. Returns early when the bounds
+         * prove optimality, or when no configuration can continue.
+         */
+        StopReason step_for(double num_seconds, size_t num_steps)
+        {
+            double start = time_since_start();
+            stop_ = is_optimal();
+            for (size_t i = 0; i < searches_.size(); ++i)
+            {
+                if (!is_active(i))
+                    continue;
+                pool_.submit([this, i, start, num_seconds, num_steps]() {
+                    Search<Heuristic>& s = *searches_[i];
+                    while (!stop_ && stop_reasons_[i] == StopReason::NONE)
+                    {
+                        share_incumbent_(i);
+                        stop_reasons_[i] = s.steps(num_steps);
+                        publish_(i);
+                        if (time_since_start() - start >= num_seconds)
+                            break;
+                    }
+                });
+            }
+            pool_.wait();
+
+            if (is_optimal())
+                return StopReason::OPTIMAL;
+            for (size_t i = 0; i < searches_.size(); ++i)
+                if (is_active(i))
+                    return StopReason::NONE;
+            return StopReason::NO_MORE_OPEN;
+        }
+
+        /** Seconds since the construction of the first configuration */
+        double time_since_start() const { return searches_[0]->time_since_start(); }
+
+        /**
+         * Lower bound: the best solution of any configuration (NaN when
+         * there is none). Upper bound: the tightest upper bound of any
+         * configuration, the top of its open list.
+         */
+        std::tuple<FloatT, FloatT, FloatT> current_bounds() const
+        {
+            FloatT lo = best_.load();
+            FloatT top = std::numeric_limits<FloatT>::quiet_NaN();
+            for (size_t i = 0; i < searches_.size(); ++i)
+            {
+                FloatT t = tops_[i].load();
+                if (!std::isnan(t) && (std::isnan(top)
+                            || heuristic_().cmp_open_score(top, t)))
+                    top = t;
+            }
+            FloatT up = top;
+            if (!std::isnan(lo) && (std::isnan(up) || up < lo))
+                up = lo; // as in Search::current_bounds
+            return {lo, up, top};
+        }
+
+        /** Some configuration cannot improve on the best solution. */
+        bool is_optimal() const
+        {
+            auto &&[lo, up, top] = current_bounds();
+            return !std::isnan(lo) && !std::isnan(top)
+                && !heuristic_().cmp_open_score(top, lo);
+        }
+
+        /** The configuration with the best solution, or -1 if none */
+        int best_config() const
+        {
+            int best = -1;
+            for (size_t i = 0; i < searches_.size(); ++i)
+            {
+                if (searches_[i]->num_solutions() == 0)
+                    continue;
+                if (best == -1 || heuristic_().cmp_open_score(
+                            std::get<0>(searches_[i]->current_bounds()),
+                            std::get<0>(searches_[best]->current_bounds())))
+                    best = static_cast<int>(i);
+            }
+            return best;
+        }
+
+        /** The best solution of all configurations. */
+        const Solution& get_best_solution() const
+        {
+            int best = best_config();
+            if (best == -1)
+                throw std::runtime_error("no solutions");
+            return searches_[best]->get_solution(0);
+        }
+    }; // class PortfolioSearch
+
+} // namespace veritas
+
+#endif // VERITAS_PORTFOLIO_SEARCH_HPP
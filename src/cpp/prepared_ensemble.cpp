@@ -0,0 +1,146 @@
+/**
+ * \file prepared_ensemble.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "prepared_ensemble.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace veritas {
+
+    // the node boxes are not counted against a search's memory capacity
+    static constexpr size_t NO_MEM_LIMIT = std::numeric_limits<size_t>::max() / 2;
+
+    PreparedEnsemble::PreparedEnsemble(const AddTree& at)
+        : at_(at.neutralize_negative_leaf_values())
+    {
+        // lets the heuristics skip subtrees, see LeafIter::next(FloatT)
+        for (size_t i = 0; i < at_.size(); ++i)
+            if (!at_[i].has_minmax_cache())
+                at_[i].cache_minmax();
+
+        Box workspace;
+        node_box_.resize(at_.size());
+        for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
+        {
+            const Tree& tree = at_[tree_index];
+            node_box_[tree_index].resize(tree.num_nodes(), BoxRef::null_box());
+            compute_node_box_(tree_index, tree.root_const(), workspace);
+        }
+
+        compute_feat_trees_();
+        compute_tree_feats_();
+        build_leaf_tables_();
+    }
+
+    PreparedEnsemble::PreparedEnsemble(const PreparedEnsemble& base, BoxRef box)
+        : at_(base.at_)
+        , node_box_(base.node_box_)
+        , feat_trees_(base.feat_trees_)
+    {
+        Box workspace;
+        for (std::vector<BoxRef>& boxes : node_box_)
+        {
+            for (BoxRef& node_box : boxes)
+            {
+                if (node_box.overlaps(box))
+                {
+                    combine_boxes(node_box, box, false, workspace);
+                    node_box = BoxRef(store_.store(workspace, NO_MEM_LIMIT));
+                    workspace.clear();
+                }
+                else
+                {
+                    node_box = BoxRef::invalid_box();
+                }
+            }
+        }
+
+        compute_tree_feats_(); // leaf boxes now include `box`
+        build_leaf_tables_();
+    }
+
+    void
+    PreparedEnsemble::compute_node_box_(size_t tree_index, Tree::ConstRef n,
+            Box& workspace)
+    {
+        if (n.is_leaf())
+            return;
+
+        const LtSplit& split = n.get_split();
+
+        BoxRef pbox = node_box_[tree_index].at(n.id());
+        workspace.resize(pbox.size());
+
+        std::copy(pbox.begin(), pbox.end(), workspace.begin());
+        Domain& dom = get_domain(workspace, split.feat_id);
+
+        auto&& [ldom, rdom] = dom.split(split.split_value);
+
+        dom = ldom;
+        node_box_[tree_index][n.left().id()] = BoxRef(store_.store(workspace, NO_MEM_LIMIT));
+
+        dom = rdom;
+        node_box_[tree_index][n.right().id()] = BoxRef(store_.store(workspace, NO_MEM_LIMIT));
+
+        workspace.clear();
+
+        compute_node_box_(tree_index, n.left(), workspace);
+        compute_node_box_(tree_index, n.right(), workspace);
+    }
+
+    void
+    PreparedEnsemble::compute_feat_trees_()
+    {
+        for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
+        {
+            const Tree& tree = at_[tree_index];
+            for (NodeId id = 0; id < static_cast<NodeId>(tree.num_nodes()); ++id)
+            {
+                if (tree[id].is_leaf())
+                    continue;
+                FeatId feat_id = tree[id].get_split().feat_id;
+                if (feat_trees_.size() <= static_cast<size_t>(feat_id))
+                    feat_trees_.resize(feat_id+1);
+                std::vector<size_t>& trees = feat_trees_[feat_id];
+                if (trees.empty() || trees.back() != tree_index)
+                    trees.push_back(tree_index);
+            }
+        }
+    }
+
+    void
+    PreparedEnsemble::compute_tree_feats_()
+    {
+        tree_feats_.assign(at_.size(), {});
+        for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
+        {
+            std::vector<FeatId>& feats = tree_feats_[tree_index];
+            for (BoxRef box : node_box_[tree_index])
+                if (!box.is_invalid_box())
+                    for (auto &&[feat_id, dom] : box)
+                        feats.push_back(feat_id);
+            std::sort(feats.begin(), feats.end());
+            feats.erase(std::unique(feats.begin(), feats.end()), feats.end());
+        }
+    }
+
+    void
+    PreparedEnsemble::build_leaf_tables_()
+    {
+        leaf_tables_.clear();
+        for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
+        {
+            const Tree& tree = at_[tree_index];
+            if (tree.num_leafs() >= LEAF_TABLE_MIN_LEAFS)
+                leaf_tables_.emplace_back(tree, node_box_[tree_index]);
+            else
+                leaf_tables_.emplace_back();
+        }
+    }
+
+} // namespace veritas
@@ -0,0 +1,85 @@
+/**
+ * \file prepared_ensemble.hpp
+ *
+ * The preprocessing of an ensemble that does not depend on the search.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_PREPARED_ENSEMBLE_HPP
+#define VERITAS_PREPARED_ENSEMBLE_HPP
+
+#include "domain.hpp"
+#include "tree.hpp"
+#include "block_store.hpp"
+#include "leaf_table.hpp"
+#include <memory>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * An ensemble prepared for Search: the trees with their negative leaf
+     * values neutralized (see AddTree::neutralize_negative_leaf_values) and
+     * cached subtree min/max leaf values, the box of each node, the trees
+     * that split on each feature, and the leaf box tables of wide trees.
+     *
+     * Immutable once constructed, and therefore safe to share between
+     * concurrent searches. A Search constructed from a shared
+     * PreparedEnsemble skips all of this work.
+     */
+    class PreparedEnsemble {
+        AddTree at_;
+        BlockStore<DomainPair> store_;
+        std::vector<std::vector<BoxRef>> node_box_;
+        std::vector<std::vector<size_t>> feat_trees_;
+        std::vector<std::vector<FeatId>> tree_feats_;
+        std::vector<LeafBoxTable> leaf_tables_;
+
+        void compute_node_box_(size_t tree_index, Tree::ConstRef n, Box& workspace);
+        void compute_feat_trees_();
+        void compute_tree_feats_();
+        void build_leaf_tables_();
+
+    public:
+        /** Trees with fewer leaves have no LeafBoxTable. */
+        static constexpr size_t LEAF_TABLE_MIN_LEAFS = 32;
+
+        /** Prepare `at`. */
+        explicit PreparedEnsemble(const AddTree& at);
+
+        /** `base` restricted to `box`: nodes whose box does not overlap with
+         * `box` get an invalid box. */
+        PreparedEnsemble(const PreparedEnsemble& base, BoxRef box);
+
+        static std::shared_ptr<const PreparedEnsemble> create(const AddTree& at)
+        { return std::make_shared<const PreparedEnsemble>(at); }
+
+        /** The neutralized ensemble. */
+        inline const AddTree& addtree() const { return at_; }
+        inline size_t num_trees() const { return at_.size(); }
+
+        /** node_box(tree)[node_id]: the box of the node, possibly invalid */
+        inline const std::vector<BoxRef>& node_box(size_t tree_index) const
+        { return node_box_[tree_index]; }
+
+        /** feat_trees()[feat_id]: the trees that split on feat_id */
+        inline const std::vector<std::vector<size_t>>& feat_trees() const
+        { return feat_trees_; }
+
+        /** tree_feats()[tree]: the sorted features in the tree's node boxes */
+        inline const std::vector<std::vector<FeatId>>& tree_feats() const
+        { return tree_feats_; }
+
+        /** Empty for trees with fewer than LEAF_TABLE_MIN_LEAFS leaves. */
+        inline const LeafBoxTable& leaf_table(size_t tree_index) const
+        { return leaf_tables_[tree_index]; }
+
+        size_t mem_size() const { return store_.get_mem_size(); }
+    }; // class PreparedEnsemble
+
+} // namespace veritas
+
+#endif // VERITAS_PREPARED_ENSEMBLE_HPP
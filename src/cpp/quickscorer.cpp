@@ -0,0 +1,183 @@
+/**
+ * \file quickscorer.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "quickscorer.hpp"
+#include <algorithm>
+#include <stack>
+#include <tuple>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace veritas {
+
+    namespace inner {
+        static inline size_t
+        count_trailing_zeros(uint64_t w)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, w);
+            return static_cast<size_t>(index);
+#else
+            return static_cast<size_t>(__builtin_ctzll(w));
+#endif
+        }
+    } // namespace inner
+
+    QuickScorer::QuickScorer(const AddTree& at)
+        : base_score(at.base_score)
+    {
+        struct SplitInfo {
+            FeatId feat_id;
+            FloatT split_value;
+            size_t word;
+            size_t mask_begin, mask_end; // in `masks`
+        };
+        std::vector<SplitInfo> splits;
+        std::vector<Word> masks;
+        std::vector<size_t> first_leaf;
+
+        for (const Tree& tree : at)
+        {
+            size_t num_leafs = tree.num_leafs();
+            size_t word_offset = num_words_;
+            tree_word_offset_.push_back(word_offset);
+            tree_leaf_offset_.push_back(leaf_values_.size());
+            num_words_ += (num_leafs + WORD_BITS - 1) / WORD_BITS;
+
+            // number the leafs left to right; the leafs of a subtree are
+            // [first_leaf[subtree root], first_leaf[root of next subtree])
+            first_leaf.assign(tree.num_nodes(), 0);
+            size_t leaf_count = 0;
+            std::stack<Tree::ConstRef, std::vector<Tree::ConstRef>> stack;
+            stack.push(tree.root());
+            while (!stack.empty())
+            {
+                Tree::ConstRef n = stack.top();
+                stack.pop();
+                first_leaf[n.id()] = leaf_count;
+                if (n.is_leaf())
+                {
+                    leaf_values_.push_back(n.leaf_value());
+                    ++leaf_count;
+                }
+                else
+                {
+                    stack.push(n.right());
+                    stack.push(n.left());
+                }
+            }
+
+            // when the test of a split fails, the leafs in the left subtree
+            // become unreachable
+            for (size_t i = 0; i < tree.num_nodes(); ++i)
+            {
+                Tree::ConstRef n = tree[static_cast<NodeId>(i)];
+                if (n.is_leaf())
+                    continue;
+
+                size_t lo = first_leaf[n.left().id()];
+                size_t hi = first_leaf[n.right().id()];
+                size_t wbegin = lo / WORD_BITS, wend = (hi-1) / WORD_BITS + 1;
+                size_t mask_begin = masks.size();
+                for (size_t w = wbegin; w < wend; ++w)
+                {
+                    size_t blo = std::max(lo, w * WORD_BITS) - w * WORD_BITS;
+                    size_t bhi = std::min(hi, (w+1) * WORD_BITS) - w * WORD_BITS;
+                    Word range = (bhi - blo == WORD_BITS)
+                        ? ~Word(0)
+                        : ((Word(1) << (bhi - blo)) - 1) << blo;
+                    masks.push_back(~range);
+                }
+
+                LtSplit split = n.get_split();
+                splits.push_back({split.feat_id, split.split_value,
+                        word_offset + wbegin, mask_begin, masks.size()});
+            }
+        }
+
+        std::sort(splits.begin(), splits.end(), [](const SplitInfo& a, const SplitInfo& b) {
+            return std::tie(a.feat_id, a.split_value) < std::tie(b.feat_id, b.split_value);
+        });
+
+        split_value_.reserve(splits.size());
+        split_word_.reserve(splits.size());
+        split_mask_.reserve(splits.size() + 1);
+        masks_.reserve(masks.size());
+        for (size_t i = 0; i < splits.size(); ++i)
+        {
+            const SplitInfo& s = splits[i];
+            if (i == 0 || splits[i-1].feat_id != s.feat_id)
+            {
+                feat_ids_.push_back(s.feat_id);
+                feat_offset_.push_back(i);
+            }
+            split_value_.push_back(s.split_value);
+            split_word_.push_back(s.word);
+            split_mask_.push_back(masks_.size());
+            masks_.insert(masks_.end(), masks.begin() + s.mask_begin,
+                    masks.begin() + s.mask_end);
+        }
+        feat_offset_.push_back(splits.size());
+        split_mask_.push_back(masks_.size());
+    }
+
+    FloatT
+    QuickScorer::eval_(const data& row, std::vector<Word>& bitvector) const
+    {
+        std::fill(bitvector.begin(), bitvector.end(), ~Word(0));
+
+        for (size_t k = 0; k < feat_ids_.size(); ++k)
+        {
+            FloatT x = row[feat_ids_[k]];
+            for (size_t i = feat_offset_[k]; i < feat_offset_[k+1]; ++i)
+            {
+                // split values are sorted, all remaining tests succeed
+                // (NaN never succeeds, it goes right like in LtSplit::test)
+                if (x < split_value_[i])
+                    break;
+
+                Word *w = &bitvector[split_word_[i]];
+                for (size_t m = split_mask_[i]; m < split_mask_[i+1]; ++m, ++w)
+                    *w &= masks_[m];
+            }
+        }
+
+        // same summation order as AddTree::eval
+        FloatT v = base_score;
+        for (size_t t = 0; t < size(); ++t)
+        {
+            // the rightmost leaf is never cleared, there always is a set bit
+            size_t w = tree_word_offset_[t];
+            while (bitvector[w] == 0)
+                ++w;
+            size_t leaf = (w - tree_word_offset_[t]) * WORD_BITS
+                + inner::count_trailing_zeros(bitvector[w]);
+            v += leaf_values_[tree_leaf_offset_[t] + leaf];
+        }
+        return v;
+    }
+
+    FloatT
+    QuickScorer::eval(const data& row) const
+    {
+        std::vector<Word> bitvector(num_words_);
+        return eval_(row, bitvector);
+    }
+
+    void
+    QuickScorer::eval(const data& d, FloatT *out) const
+    {
+        std::vector<Word> bitvector(num_words_);
+        for (size_t r = 0; r < d.num_rows; ++r)
+            out[r] = eval_(d.row(r), bitvector);
+    }
+
+} // namespace veritas
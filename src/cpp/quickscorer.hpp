@@ -0,0 +1,81 @@
+/**
+ * \file quickscorer.hpp
+ *
+ * QuickScorer-style evaluation of an AddTree using leaf bitvectors.
+ *
+ * Lucchese, C., Nardini, F. M., Orlando, S., Perego, R., Tonellotto, N., &
+ * Venturini, R. (2015). QuickScorer: A Fast Algorithm to Rank Documents with
+ * Additive Ensembles of Regression Trees. SIGIR 2015.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_QUICKSCORER_HPP
+#define VERITAS_QUICKSCORER_HPP
+
+#include "tree.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Immutable evaluation engine for an AddTree that does not traverse the
+     * trees.
+     *
+     * Each tree has a bitvector with one bit per leaf, numbered left to
+     * right. The splits of all trees are grouped per feature and sorted by
+     * split value. An instance is scored by scanning, for each feature, the
+     * splits whose test `x < split_value` fails, and clearing the bits of
+     * the leaves in the left subtrees of those splits. The leftmost leaf
+     * that remains in a tree's bitvector is the leaf the instance ends up
+     * in.
+     *
+     * Pays off for ensembles of many shallow trees. The output is bit-exact
+     * with AddTree::eval.
+     */
+    class QuickScorer {
+        using Word = uint64_t;
+        const static size_t WORD_BITS = 64;
+
+        // splits, grouped per feature, sorted by split value
+        std::vector<FeatId> feat_ids_;      /* features with splits */
+        std::vector<size_t> feat_offset_;   /* splits of feat_ids_[k] in [feat_offset_[k], feat_offset_[k+1]) */
+        std::vector<FloatT> split_value_;
+        std::vector<size_t> split_word_;    /* first bitvector word affected */
+        std::vector<size_t> split_mask_;    /* masks in [split_mask_[i], split_mask_[i+1]) */
+        std::vector<Word> masks_;
+
+        // per tree
+        size_t num_words_ = 0;
+        std::vector<size_t> tree_word_offset_;
+        std::vector<size_t> tree_leaf_offset_;
+        std::vector<FloatT> leaf_values_;
+
+    public:
+        FloatT base_score; /**< See AddTree::base_score */
+
+        explicit QuickScorer(const AddTree& at);
+
+        /** Number of trees. */
+        inline size_t size() const { return tree_word_offset_.size(); }
+        /** Number of 64-bit words in the leaf bitvectors of all trees. */
+        inline size_t num_words() const { return num_words_; }
+        /** Number of splits of all trees. */
+        inline size_t num_splits() const { return split_value_.size(); }
+
+        /** Evaluate the ensemble on the first row of `row`. */
+        FloatT eval(const data& row) const;
+
+        /** Evaluate the ensemble on all rows of `d`, write to `out`. */
+        void eval(const data& d, FloatT *out) const;
+
+    private:
+        FloatT eval_(const data& row, std::vector<Word>& bitvector) const;
+    }; // QuickScorer
+
+} // namespace veritas
+
+#endif // VERITAS_QUICKSCORER_HPP
@@ -0,0 +1,159 @@
+/**
+ * \file robustness.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "robustness.hpp"
+#include "search.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace veritas {
+
+    /** The example in `box` closest to `example`, see util.get_closest_example */
+    static std::vector<FloatT>
+    closest_example(BoxRef box, const data& example)
+    {
+        std::vector<FloatT> closest(example.num_cols);
+        for (size_t i = 0; i < example.num_cols; ++i)
+            closest[i] = example[i];
+        for (auto &&[feat_id, dom] : box)
+        {
+            FloatT x = closest.at(feat_id);
+            if (dom.contains(x))
+                continue;
+            closest[feat_id] = (std::abs(dom.lo - x) > std::abs(x - dom.hi))
+                ? dom.hi : dom.lo;
+        }
+        return closest;
+    }
+
+    static FloatT
+    linf_distance(const std::vector<FloatT>& a, const data& b)
+    {
+        FloatT dist = 0.0;
+        for (size_t i = 0; i < a.size(); ++i)
+            dist = std::max(dist, std::abs(a[i] - b[i]));
+        return dist;
+    }
+
+    RobustnessSearch::RobustnessSearch(const AddTree& source_at,
+            const AddTree& target_at)
+    {
+        if (source_at.size() == 0 && target_at.size() == 0)
+            throw std::runtime_error("RobustnessSearch: source_at and target_at empty");
+        prep_ = PreparedEnsemble::create(target_at.concat_negated(source_at));
+    }
+
+    RobustnessResult
+    RobustnessSearch::search_one(const data& example, double max_time) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [start]() {
+            return std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+        };
+
+        RobustnessResult res;
+        res.delta = start_delta + guard;
+        res.lower = 0.0;
+        res.upper = res.delta;
+        FloatT best_example_delta = FLOATT_INF;
+
+        for (size_t i = 0; i < num_steps; ++i)
+        {
+            double step_time = (max_time - elapsed()) / (num_steps - i);
+            if (step_time < 0.0)
+                break;
+
+            Search<MaxOutputHeuristic> s(prep_);
+            s.stop_when_optimal = true;
+            s.stop_when_upper_less_than = 0.0;
+            s.stop_when_num_solutions_exceeds = 1;
+            s.reject_solution_when_output_less_than = 0.0;
+            s.max_focal_size = 10000;
+            s.auto_eps = false;
+            s.eps = 0.05;
+            s.set_mem_capacity(mem_capacity);
+
+            Box box;
+            for (size_t j = 0; j < example.num_cols; ++j)
+                refine_box(box, static_cast<FeatId>(j),
+                        {example[j] - res.delta, example[j] + res.delta});
+            s.restrict_to_box(BoxRef(box));
+
+            s.step_for(step_time, 100);
+
+            // (max. target output)-(min. source output)>=0 -> an adv. can exist
+            FloatT max_output_diff = std::get<1>(s.current_bounds());
+            FloatT step_example_delta = res.delta;
+            if (s.num_solutions() > 0)
+            {
+                const Solution& sol = s.get_solution(0);
+                if (sol.output > 0.0)
+                    max_output_diff = sol.output;
+
+                std::vector<FloatT> closest = closest_example(sol.box, example);
+                FloatT example_delta = linf_distance(closest, example) + guard;
+                step_example_delta = std::min(step_example_delta, example_delta);
+                if (example_delta < best_example_delta)
+                {
+                    best_example_delta = example_delta;
+                    res.example = std::move(closest);
+                }
+            }
+
+            if (max_output_diff >= 0.0)
+            {
+                res.upper = std::min(res.delta, step_example_delta);
+                res.delta = res.upper - 0.5 * (res.upper - res.lower);
+            }
+            else if (res.delta == res.upper && res.lower == 0.0)
+            {
+                res.lower = res.delta;
+                res.delta = 2.0 * res.delta;
+                res.upper = res.delta;
+            }
+            else if (res.upper != 0.0 && (res.upper - res.lower) / res.upper < 1e-5)
+            {
+                break;
+            }
+            else
+            {
+                res.lower = res.delta;
+                res.delta = res.lower + 0.5 * (res.upper - res.lower);
+            }
+        }
+
+        return res;
+    }
+
+    std::vector<RobustnessResult>
+    RobustnessSearch::search(const data& examples,
+            const std::vector<double>& max_times) const
+    {
+        if (max_times.size() != examples.num_rows)
+            throw std::runtime_error("RobustnessSearch: one max_time per example");
+
+        std::vector<RobustnessResult> results(examples.num_rows);
+        ThreadPool pool(std::min<size_t>(num_threads == 0
+                    ? std::max(1u, std::thread::hardware_concurrency())
+                    : num_threads, std::max<size_t>(1, examples.num_rows)));
+
+        // one task per example: idle threads take the next example from the
+        // shared queue, so slow examples do not hold up the others
+        for (size_t i = 0; i < examples.num_rows; ++i)
+            pool.submit([this, &results, &examples, &max_times, i]() {
+                results[i] = search_one(examples.row(i), max_times[i]);
+            });
+        pool.wait();
+
+        return results;
+    }
+
+} // namespace veritas
@@ -0,0 +1,78 @@
+/**
+ * \file robustness.hpp
+ *
+ * Batched robustness checking: the binary search over the L-infinity radius
+ * of robustness.py's VeritasRobustnessSearch, for many examples at once.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_ROBUSTNESS_HPP
+#define VERITAS_ROBUSTNESS_HPP
+
+#include "basics.hpp"
+#include "tree.hpp"
+#include "prepared_ensemble.hpp"
+#include <memory>
+#include <vector>
+
+namespace veritas {
+
+    /** The outcome of the robustness search of one example. */
+    struct RobustnessResult {
+        /** Last radius of the binary search */
+        FloatT delta;
+        /** No adversarial example within `lower` of the example */
+        FloatT lower;
+        /** The smallest radius with a possible adversarial example */
+        FloatT upper;
+        /** The closest adversarial example found, empty if none was found */
+        std::vector<FloatT> example;
+    };
+
+    /**
+     * Find the L-infinity distance from examples to the closest example for
+     * which `target_at` outputs more than `source_at`.
+     *
+     * For each example, a binary search over the radius `delta` runs a
+     * MaxOutputHeuristic Search on `target_at - source_at` restricted to the
+     * box of radius `delta` around the example. All these searches share a
+     * single PreparedEnsemble (see Search::restrict_to_box). The examples are
+     * distributed over a thread pool, one task per example.
+     */
+    class RobustnessSearch {
+        std::shared_ptr<const PreparedEnsemble> prep_;
+
+    public:
+        /** Initial radius of the binary search */
+        FloatT start_delta = 1.0;
+        /** Number of binary search steps per example */
+        size_t num_steps = 10;
+        /** Added to the distance of generated examples, see robustness.py */
+        FloatT guard = 0.0;
+        /** Memory capacity of each Search */
+        size_t mem_capacity = size_t(1024)*1024*1024;
+        /** Number of threads, 0 for one per hardware thread */
+        size_t num_threads = 0;
+
+        /** An empty `source_at` or `target_at` contributes nothing. */
+        RobustnessSearch(const AddTree& source_at, const AddTree& target_at);
+
+        const PreparedEnsemble& prepared() const { return *prep_; }
+
+        /** Binary search around `example` for at most `max_time` seconds */
+        RobustnessResult search_one(const data& example, double max_time) const;
+
+        /**
+         * Search around each row of `examples`, with a time budget of
+         * `max_times[i]` seconds for row `i`.
+         */
+        std::vector<RobustnessResult> search(const data& examples,
+                const std::vector<double>& max_times) const;
+    }; // class RobustnessSearch
+
+} // namespace veritas
+
+#endif // VERITAS_ROBUSTNESS_HPP
@@ -12,11 +12,19 @@
 #include "domain.hpp"
 #include "tree.hpp"
 #include "block_store.hpp"
+#include "box_cache.hpp"
+#include "leaf_table.hpp"
+#include "prepared_ensemble.hpp"
+#include "thread_pool.hpp"
 #include <array>
+#include <cstring>
+#include <atomic>
 #include <iostream>
 #include <chrono>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <functional>
 
 #include <iomanip>
@@ -28,6 +36,28 @@ namespace veritas {
     using time_point = std::chrono::time_point<std::chrono::system_clock>;
     struct BaseHeuristic; /* heuristics.hpp */
 
+    namespace inner {
+        /** Hash of the domains of a box, used to partition the states over
+         * the HDA* workers. */
+        inline uint64_t hash_box(BoxRef box)
+        {
+            uint64_t h = 0x9e3779b97f4a7c15ull;
+            auto mix = [&h](uint64_t k) {
+                h ^= k + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+                h *= 0xbf58476d1ce4e5b9ull;
+            };
+            for (auto &&[feat_id, dom] : box)
+            {
+                uint32_t lo, hi;
+                std::memcpy(&lo, &dom.lo, sizeof(lo));
+                std::memcpy(&hi, &dom.hi, sizeof(hi));
+                mix(static_cast<uint64_t>(feat_id));
+                mix((static_cast<uint64_t>(lo) << 32) | hi);
+            }
+            return h ^ (h >> 31);
+        }
+    } // namespace inner
+
     struct Solution {
         double time;
         FloatT eps;
@@ -43,6 +73,8 @@ namespace veritas {
         FloatT eps = 0.0;
         std::tuple<FloatT, FloatT, FloatT> bounds = {-FLOATT_INF, FLOATT_INF, FLOATT_INF}; // lo, up_a, up_ara
         double avg_focal_size = 0.0;
+        size_t num_cache_hits = 0; // see VSearch::tree_cache_slots
+        size_t num_cache_misses = 0;
     };
 
     enum class StopReason {
@@ -125,13 +157,71 @@ namespace veritas {
         }
 
         /* find next overlapping leaf */
-        NodeId next()
+        NodeId next() { return next_<Bound::NONE>(0.0); }
+
+        /**
+         * Bounded traversal for maximization: find the next overlapping leaf
+         * whose value can exceed `bound`, the best value found so far.
+         * Children are visited largest subtree maximum first, and subtrees
+         * whose maximum is not greater than `bound` are skipped, so only a
+         * path or so is expanded once the bound is tight. Requires a min/max
+         * cache (Tree::cache_minmax), otherwise this is a plain `next()`.
+         */
+        NodeId next(FloatT bound)
+        {
+            if (tree_ != nullptr && tree_->has_minmax_cache())
+                return next_<Bound::MAX>(bound);
+            return next_<Bound::NONE>(bound);
+        }
+
+        /** Like `next(FloatT)`, but for minimization: smallest minimum first,
+         * skip subtrees whose minimum is not less than `bound`. */
+        NodeId next_min(FloatT bound)
+        {
+            if (tree_ != nullptr && tree_->has_minmax_cache())
+                return next_<Bound::MIN>(bound);
+            return next_<Bound::NONE>(bound);
+        }
+
+    private:
+        enum class Bound { NONE, MAX, MIN };
+
+        /** Can subtree `n` improve upon `bound`? */
+        template <Bound B>
+        static bool can_improve_(Tree::ConstRef n, FloatT bound)
+        {
+            if constexpr (B == Bound::MAX)
+                return std::get<1>(n.find_minmax_leaf_value()) > bound;
+            if constexpr (B == Bound::MIN)
+                return std::get<0>(n.find_minmax_leaf_value()) < bound;
+            return true;
+        }
+
+        /** Should `a` be visited before `b`? */
+        template <Bound B>
+        static bool visit_first_(Tree::ConstRef a, Tree::ConstRef b)
+        {
+            if constexpr (B == Bound::MAX)
+                return std::get<1>(a.find_minmax_leaf_value())
+                    > std::get<1>(b.find_minmax_leaf_value());
+            if constexpr (B == Bound::MIN)
+                return std::get<0>(a.find_minmax_leaf_value())
+                    < std::get<0>(b.find_minmax_leaf_value());
+            return false;
+        }
+
+        template <Bound B>
+        NodeId next_(FloatT bound)
         {
             while (!stack_.empty())
             {
                 Tree::ConstRef n = tree_->node_const(stack_.back());
                 stack_.pop_back();
 
+                // the bound may have improved since `n` was pushed
+                if (!can_improve_<B>(n, bound))
+                    continue;
+
                 if (n.is_leaf())
                     return n.id();
 
@@ -142,10 +232,21 @@ namespace veritas {
 
                 // null box is quick indicator that node is unreachable due to
                 // additional constraints
-                if (d.hi >= s.split_value)
-                    stack_.push_back(n.right().id());
-                if (d.lo < s.split_value)
-                    stack_.push_back(n.left().id());
+                bool go_right = d.hi >= s.split_value;
+                bool go_left = d.lo < s.split_value;
+                Tree::ConstRef l = n.left(), r = n.right();
+
+                // stack: the child pushed last is visited first
+                if (go_left && go_right && visit_first_<B>(r, l))
+                {
+                    stack_.push_back(l.id());
+                    stack_.push_back(r.id());
+                    continue;
+                }
+                if (go_right)
+                    stack_.push_back(r.id());
+                if (go_left)
+                    stack_.push_back(l.id());
             }
             tree_ = nullptr;
             return -1;
@@ -155,16 +256,47 @@ namespace veritas {
     /** See Search */
     class VSearch {
     protected:
+        /** Node boxes and split index, shared with other searches. */
+        std::shared_ptr<const PreparedEnsemble> prep_;
         AddTree at_;
 
-        VSearch(const AddTree& at)
-            : at_{at.neutralize_negative_leaf_values()} {}
+        VSearch(std::shared_ptr<const PreparedEnsemble> prep)
+            : prep_{std::move(prep)}
+            , at_{prep_->addtree()} {}
+
+        /** Copy the settings (not the statistics) of `o`. */
+        void copy_settings_(const VSearch& o)
+        {
+            eps = o.eps;
+            max_focal_size = o.max_focal_size;
+            debug = o.debug;
+            auto_eps = o.auto_eps;
+            incremental_heuristic = o.incremental_heuristic;
+            tree_cache_slots = o.tree_cache_slots;
+            use_leaf_tables = o.use_leaf_tables;
+            num_threads = o.num_threads;
+            reject_solution_when_output_less_than = o.reject_solution_when_output_less_than;
+            stop_when_num_solutions_exceeds = o.stop_when_num_solutions_exceeds;
+            stop_when_num_new_solutions_exceeds = o.stop_when_num_new_solutions_exceeds;
+            stop_when_optimal = o.stop_when_optimal;
+            stop_when_upper_less_than = o.stop_when_upper_less_than;
+            stop_when_lower_greater_than = o.stop_when_lower_greater_than;
+        }
 
     public:
         static std::shared_ptr<VSearch> max_output(const AddTree& at);
         static std::shared_ptr<VSearch> min_dist_to_example(const AddTree& at,
                 const std::vector<FloatT>& ex,
                 FloatT output_threshold);
+        static std::shared_ptr<VSearch> max_output(
+                std::shared_ptr<const PreparedEnsemble> prep);
+        static std::shared_ptr<VSearch> min_dist_to_example(
+                std::shared_ptr<const PreparedEnsemble> prep,
+                const std::vector<FloatT>& ex,
+                FloatT output_threshold);
+
+        /** The preprocessed ensemble, to construct more searches from. */
+        std::shared_ptr<const PreparedEnsemble> prepared() const { return prep_; }
 
         /* possibly different because `neutralize_negative_leaf_values` */
         FloatT base_score() const { return at_.base_score; }
@@ -187,12 +319,31 @@ namespace veritas {
         virtual FloatT get_at_output_for_box(BoxRef box) const = 0;
         virtual bool is_optimal() const = 0;
         virtual void prune_by_box(BoxRef box) = 0;
+        virtual void restrict_to_box(BoxRef box) = 0;
 
         // settings
         FloatT eps = 0.95;
         size_t max_focal_size = 1000;
         bool debug = false;
         bool auto_eps = true;
+        /** Reuse the parent's per-tree heuristic terms for trees whose split
+         * features did not change (costs a float per remaining tree per
+         * state). */
+        bool incremental_heuristic = true;
+        /** Slots per tree of the caches of per-tree heuristic terms keyed
+         * by the state's box on the tree's features (0 disables). */
+        size_t tree_cache_slots = 64;
+        /** Find the leaves overlapping with a state with a LeafBoxTable
+         * instead of LeafIter for trees with many leaves. */
+        bool use_leaf_tables = true;
+        /**
+         * Number of worker threads for `steps` and `step_for` (0 = one per
+         * hardware thread). With more than one, the search runs as HDA*:
+         * each worker owns a part of the open list, states go to the worker
+         * given by the hash of their box. Read when the search first steps;
+         * constraints must be added before that.
+         */
+        size_t num_threads = 1;
 
         FloatT reject_solution_when_output_less_than = -FLOATT_INF;
 
@@ -289,10 +440,49 @@ namespace veritas {
             /** \private */ std::vector<size_t> focal;
             /** \private */ LeafIter leafiter1; // expand_
             /** \private */ LeafIter leafiter2; // heurstic computation
+            /** \private */ std::vector<FloatT> tree_bounds;
+            /** \private */ std::vector<char> changed_trees;
+            /** \private */ std::vector<uint64_t> cache_key;
+            /** \private */ std::vector<NodeId> leaf_ids1; // expand_
+            /** \private */ std::vector<NodeId> leaf_ids2; // heuristic computation
         } workspace_;
 
-        /** node_box_[tree][leaf_id] given constraints */
-        std::vector<std::vector<BoxRef>> node_box_;
+        /** BaseState::tree_bounds of the states */
+        BlockStore<FloatT> bound_store_;
+
+        /** Per-tree heuristic terms by projected box, see BaseHeuristic.
+         * Shared by the HDA* workers, use tree_cache_. */
+        mutable std::array<BoxCache, 2> tree_caches_;
+
+        /** Shared state of the HDA* workers, see VSearch::num_threads */
+        struct Hda {
+            /** The workers other than the main search, which is worker 0 */
+            std::vector<std::unique_ptr<Search>> workers;
+            ThreadPool pool;
+            std::vector<std::mutex> inbox_mutex;
+            /** States sent to a worker by the others */
+            std::vector<std::vector<State>> inbox;
+            /** States in open lists and inboxes, or being expanded */
+            std::atomic<int64_t> num_pending{0};
+            std::atomic<size_t> num_steps{0};
+            size_t max_steps = 0;
+            std::atomic<size_t> num_new_solutions{0};
+            std::atomic<bool> stop{false};
+            /** Best solution score, and the top open score of each worker
+             * (NaN when it has nothing worth expanding) */
+            std::atomic<FloatT> best{std::numeric_limits<FloatT>::quiet_NaN()};
+            std::unique_ptr<std::atomic<FloatT>[]> tops;
+
+            Hda(size_t n)
+                : pool(n), inbox_mutex(n), inbox(n)
+                , tops(new std::atomic<FloatT>[n]) {}
+
+            inline size_t size() const { return inbox.size(); }
+        };
+        std::unique_ptr<Hda> hda_; // main search only
+        Search *main_ = this;
+        Hda *running_hda_ = nullptr; // set during a parallel run
+        size_t worker_index_ = 0;
 
         /** how many open states did we look at in `pop_from_focal_`? */
         size_t sum_focal_size_ = 0;
@@ -307,7 +497,12 @@ namespace veritas {
     public:
         template <typename... HeurArgs>
         Search(const AddTree& at, HeurArgs... heur_args)
-            : VSearch(at)
+            : Search(PreparedEnsemble::create(at), heur_args...) {}
+
+        /** A search on a prepared ensemble, which is shared, not copied. */
+        template <typename... HeurArgs>
+        Search(std::shared_ptr<const PreparedEnsemble> prep, HeurArgs... heur_args)
+            : VSearch(std::move(prep))
             /*, graph_(at_)*/
             , mem_capacity_(size_t(1024)*1024*1024)
             , start_time_{std::chrono::system_clock::now()}
@@ -316,6 +511,24 @@ namespace veritas {
             init_();
         }
 
+    private:
+        /** An HDA* worker of `main`: shares its trees, node boxes, constraints
+         * and tree caches, but has its own open list and memory. */
+        Search(const Search& main, size_t worker_index, size_t num_workers)
+            : VSearch(main.prep_)
+            , mem_capacity_(main.mem_capacity_ / num_workers)
+            , start_time_(main.start_time_)
+            , callback_group_count_(main.callback_group_count_)
+            , callbacks_(main.callbacks_)
+            , main_(const_cast<Search *>(&main))
+            , worker_index_(worker_index)
+            , heuristic(main.heuristic)
+        {
+            copy_settings_(main);
+            workspace_.changed_trees.resize(at_.size());
+        }
+
+    public:
         StopReason step() { return stepv(); } // !! virtual, vtable lookup required
 
         StopReason stepv() // non virtual
@@ -336,10 +549,11 @@ namespace veritas {
                 if (heuristic.output_overestimate(state) <
                         reject_solution_when_output_less_than)
                 {
-                    std::cout << "rejected " << heuristic.output_overestimate(state)
-                        << " < " << reject_solution_when_output_less_than
-                        << " (" << heuristic.open_score(state) << ")"
-                        << std::endl;
+                    if (debug)
+                        std::cout << "rejected " << heuristic.output_overestimate(state)
+                            << " < " << reject_solution_when_output_less_than
+                            << " (" << heuristic.open_score(state) << ")"
+                            << std::endl;
                     ++num_rejected_solutions;
                 }
                 else
@@ -364,7 +578,20 @@ namespace veritas {
             size_t step_count = 0;
             sum_focal_size_ = 0;
 
-            for (; stop_reason == StopReason::NONE
+            if (tree_caches_[0].slots_per_tree() != tree_cache_slots)
+                reset_tree_caches_();
+
+            if (hda_ || num_workers_() > 1)
+            {
+                step_count = hda_steps_(num_steps);
+                if (num_sol + stop_when_num_new_solutions_exceeds
+                        <= num_solutions())
+                    return StopReason::NUM_NEW_SOLUTIONS_EXCEEDED;
+                if (num_open() == 0)
+                    stop_reason = StopReason::NO_MORE_OPEN;
+            }
+
+            for (; !hda_ && stop_reason == StopReason::NONE
                     && step_count < num_steps; ++step_count)
             {
                 stop_reason = stepv();
@@ -411,8 +638,20 @@ namespace veritas {
 
         void set_mem_capacity(size_t bytes) { mem_capacity_ = bytes; }
         size_t remaining_mem_capacity() const
-        { return mem_capacity_ - store_.get_mem_size(); }
-        size_t used_mem_size() const { return store_.get_used_mem_size(); }
+        {
+            // the stores reserve a block each up front: saturate, do not wrap
+            size_t used = store_.get_mem_size() + bound_store_.get_mem_size()
+                + tree_caches_[0].mem_size() + tree_caches_[1].mem_size();
+            return used >= mem_capacity_ ? 0 : mem_capacity_ - used;
+        }
+        size_t used_mem_size() const
+        {
+            size_t mem = store_.get_used_mem_size() + bound_store_.get_used_mem_size();
+            if (hda_)
+                for (const auto& w : hda_->workers)
+                    mem += w->used_mem_size();
+            return mem;
+        }
 
         /** Seconds since the construction of the search */
         double time_since_start() const
@@ -423,22 +662,35 @@ namespace veritas {
         }
 
         size_t num_solutions() const { return solutions_.size(); }
-        size_t num_open() const { return open_.size(); }
+        size_t num_open() const
+        {
+            size_t n = open_.size();
+            if (hda_)
+                for (const auto& w : hda_->workers)
+                    n += w->open_.size();
+            return n;
+        }
 
         /** lower, upper, top of open */
         std::tuple<FloatT, FloatT, FloatT> current_bounds() const
         {
             FloatT lo = -FLOATT_INF, up = -FLOATT_INF, top = -FLOATT_INF;
-            if (open_.size() > 0)
+            const State *best = open_.empty() ? nullptr : &open_.front();
+            if (hda_) // the best top of the workers' open lists
+                for (const auto& w : hda_->workers)
+                    if (!w->open_.empty() && (best == nullptr
+                            || heuristic.cmp_open_score(w->open_.front(), *best)))
+                        best = &w->open_.front();
+            if (best != nullptr)
             {
-                top = heuristic.open_score(open_.front());
+                top = heuristic.open_score(*best);
                 up = top;
             }
             if (num_solutions() > 0)
             {
                 // best solution so far, sols are sorted
                 lo = heuristic.open_score(solutions_[0].state);
-                if (open_.size() == 0 || (up < lo))
+                if (best == nullptr || (up < lo))
                     up = lo;
             }
             return {lo, up, top};
@@ -499,32 +751,47 @@ namespace veritas {
                 eps,
                 current_bounds(),
                 avg_focal_size,
+                tree_caches_[0].num_hits() + tree_caches_[1].num_hits(),
+                tree_caches_[0].num_misses() + tree_caches_[1].num_misses(),
             });
         }
 
         void prune_by_box(BoxRef box)
         {
-            if (open_.size() > 1)
+            if (open_.size() > 1 || hda_)
                 throw std::runtime_error("invalid state: pruning after search has started");
             /*graph_.prune_by_box(box, false);*/
 
-            for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
-            {
-                for (BoxRef& node_box : node_box_[tree_index])
-                {
-                    if (node_box.overlaps(box))
-                    {
-                        combine_boxes(node_box, box, false, workspace_.box);
-                        node_box = BoxRef(store_.store(workspace_.box,
-                                    remaining_mem_capacity()));
-                        workspace_.box.clear();
-                    }
-                    else
-                    {
-                        node_box = BoxRef::invalid_box();
-                    }
-                }
-            }
+            // copy-on-write: other searches may share the prepared ensemble
+            prep_ = std::make_shared<const PreparedEnsemble>(*prep_, box);
+
+            // terms computed before pruning are too loose to be reused
+            for (State& state : open_)
+                state.tree_bounds = nullptr;
+            reset_tree_caches_(); // leaf boxes now include `box`
+        }
+
+        /**
+         * Only search the part of the input space in `box`: it becomes the
+         * box of the initial state, which all other states refine. Unlike
+         * Search::prune_by_box, the node boxes of the PreparedEnsemble are
+         * not rebuilt, so this costs one heuristic evaluation. Replaces an
+         * earlier restriction.
+         */
+        void restrict_to_box(BoxRef box)
+        {
+            if (num_steps > 0 || open_.size() > 1 || hda_)
+                throw std::runtime_error("invalid state: restricting after search has started");
+
+            State initial_state, dummy_parent;
+            if (box.begin() != box.end())
+                initial_state.box = BoxRef(store_.store(box.begin(), box.end(),
+                            remaining_mem_capacity()));
+
+            open_.clear();
+            if (heuristic.update_heuristic(initial_state, *this, dummy_parent,
+                        at_.base_score))
+                push_with_tree_bounds_(std::move(initial_state));
         }
 
         /** Callback is called when the feature with id `feat_id` is updated. */
@@ -551,60 +818,19 @@ namespace veritas {
             if (auto_eps)
                 eps = 0.5;
 
-            // Generate node domains
-            node_box_.resize(at_.size());
-            for (size_t tree_index = 0; tree_index < at_.size(); ++tree_index)
-            {
-                const Tree& tree = at_[tree_index];
-                node_box_[tree_index].resize(tree.num_nodes(), BoxRef::null_box());
-                compute_node_box_(tree_index, tree.root_const());
-            }
+            workspace_.changed_trees.resize(at_.size());
+            reset_tree_caches_();
 
             // Push the first search state
             State initial_state, dummy_parent;
             bool success = heuristic.update_heuristic(initial_state, *this,
                     dummy_parent, at_.base_score);
             if (success)
-                push_(std::move(initial_state));
+                push_with_tree_bounds_(std::move(initial_state));
             else
                 std::cout << "Warning: initial_state invalid" << std::endl;
         }
 
-        void compute_node_box_(size_t tree_index, Tree::ConstRef n)
-        {
-            if (n.is_leaf())
-                return;
-
-            const LtSplit& split = n.get_split();
-
-            BoxRef pbox = node_box_[tree_index].at(n.id());
-            workspace_.box.resize(pbox.size());
-
-            std::copy(pbox.begin(), pbox.end(), workspace_.box.begin());
-            Domain& dom = get_domain(workspace_.box, split.feat_id);
-
-            //std::cout << "parent " << pbox << std::endl;
-            //std::cout << "  - split " << split << ", " << dom << std::endl;
-
-            auto&& [ldom, rdom] = dom.split(split.split_value);
-
-            dom = ldom;
-            BoxRef lbox { store_.store(workspace_.box, remaining_mem_capacity()) };
-            node_box_[tree_index][n.left().id()] = lbox;
-
-            dom = rdom;
-            BoxRef rbox { store_.store(workspace_.box, remaining_mem_capacity()) };
-            node_box_[tree_index][n.right().id()] = rbox;
-
-            //std::cout << "  - left " << lbox << std::endl;
-            //std::cout << "  - right " << rbox << std::endl;
-
-            workspace_.box.clear();
-
-            compute_node_box_(tree_index, n.left());
-            compute_node_box_(tree_index, n.right());
-        }
-
         bool is_solution_(const State& state)
         {
             return state.indep_set+1 == static_cast<int>(at_.size());
@@ -659,11 +885,12 @@ namespace veritas {
 
             size_t next_tree = state.indep_set + 1;
             const Tree& t = at_[next_tree];
-            workspace_.leafiter1.setup(t, state.box);
-            NodeId leaf_id = -1;
-            while ((leaf_id = workspace_.leafiter1.next()) != -1)
+            workspace_.leafiter1.setup_flatbox(state.box);
+            find_overlapping_leafs_(next_tree, workspace_.leafiter1,
+                    workspace_.leaf_ids1);
+            for (NodeId leaf_id : workspace_.leaf_ids1)
             {
-                BoxRef leaf_box = node_box_[next_tree][leaf_id];
+                BoxRef leaf_box = prep_->node_box(next_tree)[leaf_id];
                 if (leaf_box.is_invalid_box())
                 {
                     //std::cout << "skip1" << leaf_id << " because constraints " << next_tree << std::endl;
@@ -1088,14 +1315,276 @@ namespace veritas {
                 //for (const Domain& dom : workspace_.flatbox)
                 //    std::cout << "| - " << (feat_id++) << " : " << dom << std::endl;
 
-                push_(std::move(new_state));
+                push_with_tree_bounds_(std::move(new_state));
             }
 
             workspace_.flatbox.clear();
             workspace_.box.clear();
         }
 
+        /**
+         * Collect the leaves of tree `tree_index` that overlap with the box
+         * in `iter.flatbox` in `leaf_ids`, with the tree's LeafBoxTable or
+         * with `iter`. Same leaves in the same order either way, except that
+         * a table leaves out leaves with an invalid box.
+         */
+        void find_overlapping_leafs_(size_t tree_index, LeafIter& iter,
+                std::vector<NodeId>& leaf_ids) const
+        {
+            leaf_ids.clear();
+            const LeafBoxTable& table = prep_->leaf_table(tree_index);
+            if (use_leaf_tables && table.num_leafs() > 0
+                    && table.find_overlapping(iter.flatbox, leaf_ids))
+                return;
+            iter.setup_tree(at_[tree_index]);
+            NodeId leaf_id = -1;
+            while ((leaf_id = iter.next()) != -1)
+                leaf_ids.push_back(leaf_id);
+        }
+
+        void reset_tree_caches_()
+        {
+            for (size_t i = 0; i < tree_caches_.size(); ++i)
+                tree_caches_[i].reset(prep_->tree_feats(), i < Heuristic::num_tree_caches
+                        ? tree_cache_slots : 0);
+        }
+
+        /** Keep the per-tree heuristic terms in `workspace_.tree_bounds`
+         * for the children of `state`, then push it. */
+        void push_with_tree_bounds_(State&& state)
+        {
+            if (incremental_heuristic && !is_solution_(state))
+                state.tree_bounds = bound_store_.store(workspace_.tree_bounds,
+                        remaining_mem_capacity()).begin;
+            push_(std::move(state));
+        }
+
+        /** Set `workspace_.changed_trees[t]` for the trees that split on a
+         * feature whose domain differs between the boxes. */
+        void mark_changed_trees_(BoxRef parent_box, BoxRef box) const
+        {
+            auto& changed = workspace_.changed_trees;
+            std::fill(changed.begin(), changed.end(), 0);
+            auto mark = [this, &changed](FeatId feat_id) {
+                const auto& feat_trees = prep_->feat_trees();
+                if (static_cast<size_t>(feat_id) < feat_trees.size())
+                    for (size_t tree_index : feat_trees[feat_id])
+                        changed[tree_index] = 1;
+            };
+
+            // both boxes are sorted by feat_id
+            auto it0 = parent_box.begin(), end0 = parent_box.end();
+            auto it1 = box.begin(), end1 = box.end();
+            while (it0 != end0 || it1 != end1)
+            {
+                if (it1 == end1 || (it0 != end0 && it0->feat_id < it1->feat_id))
+                    mark((it0++)->feat_id);
+                else if (it0 == end0 || it1->feat_id < it0->feat_id)
+                    mark((it1++)->feat_id);
+                else
+                {
+                    if (it0->domain != it1->domain)
+                        mark(it0->feat_id);
+                    ++it0; ++it1;
+                }
+            }
+        }
+
+        BoxCache& tree_cache_(size_t c) const { return main_->tree_caches_[c]; }
+
+        /** Run the HDA* workers for about `max_steps` steps in total.
+         * \return the number of steps taken */
+        size_t hda_steps_(size_t max_steps)
+        {
+            if (!hda_)
+            {
+                size_t n = num_workers_();
+                hda_ = std::make_unique<Hda>(n);
+                for (size_t i = 1; i < n; ++i)
+                    hda_->workers.emplace_back(new Search(*this, i, n));
+                mem_capacity_ /= n;
+            }
+
+            Hda& hda = *hda_;
+            hda.num_steps = 0;
+            hda.max_steps = max_steps;
+            hda.num_new_solutions = 0;
+            hda.stop = false;
+            hda.best = solutions_.empty()
+                ? std::numeric_limits<FloatT>::quiet_NaN()
+                : heuristic.open_score(solutions_[0].state);
+            hda.num_pending = static_cast<int64_t>(num_open());
+            for (size_t i = 0; i < hda.size(); ++i)
+            {
+                Search& w = hda_worker_(i);
+                w.running_hda_ = &hda;
+                w.eps = eps;
+                w.stop_when_upper_less_than = stop_when_upper_less_than;
+                w.sum_focal_size_ = 0;
+                hda.tops[i] = std::numeric_limits<FloatT>::quiet_NaN();
+            }
+
+            for (size_t i = 0; i < hda.size(); ++i)
+                hda.pool.submit([this, i]() { hda_worker_(i).hda_work_(); });
+            try { hda.pool.wait(); }
+            catch (...) { hda_finish_(); throw; }
+            hda_finish_();
+
+            return std::min(hda.num_steps.load(), max_steps);
+        }
+
+        size_t num_workers_() const
+        {
+            return num_threads == 0
+                ? std::max(1u, std::thread::hardware_concurrency())
+                : num_threads;
+        }
+
+        Search& hda_worker_(size_t i) const
+        { return i == 0 ? *main_ : *main_->hda_->workers[i-1]; }
+
+        /** The loop of HDA* worker `worker_index_`. */
+        void hda_work_()
+        {
+            Hda& hda = *running_hda_;
+            std::atomic<FloatT>& top = hda.tops[worker_index_];
+            size_t num_iterations = 0;
+            try {
+                while (!hda.stop.load(std::memory_order_relaxed))
+                {
+                    // no worker has a state that can beat the best solution;
+                    // steps() checks again once the states in transit landed
+                    if (stop_when_optimal && worker_index_ == 0
+                            && ++num_iterations % 64 == 0 && hda_is_optimal_())
+                    {
+                        hda.stop = true;
+                        break;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(hda.inbox_mutex[worker_index_]);
+                        for (State& state : hda.inbox[worker_index_])
+                            push_local_(std::move(state));
+                        hda.inbox[worker_index_].clear();
+                    }
+
+                    // with stop_when_optimal, states that cannot beat the
+                    // best solution of any worker are not worth expanding
+                    FloatT best = hda.best.load(std::memory_order_relaxed);
+                    if (open_.empty() || (stop_when_optimal && hda_done_(best,
+                                    heuristic.open_score(open_.front()))))
+                    {
+                        top.store(std::numeric_limits<FloatT>::quiet_NaN());
+                        if (hda.num_pending.load() == 0)
+                            break; // nothing left anywhere
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    top.store(heuristic.open_score(open_.front()));
+
+                    if (hda.num_steps.fetch_add(1) >= hda.max_steps)
+                    {
+                        hda.stop = true;
+                        break;
+                    }
+
+                    size_t num_sol = solutions_.size();
+                    stepv();
+                    if (solutions_.size() > num_sol)
+                    {
+                        FloatT score = heuristic.open_score(solutions_[0].state);
+                        best = hda.best.load();
+                        while ((std::isnan(best) || heuristic.cmp_open_score(score, best))
+                                && !hda.best.compare_exchange_weak(best, score)) {}
+                        if (hda.num_new_solutions.fetch_add(1) + 1
+                                >= stop_when_num_new_solutions_exceeds)
+                            hda.stop = true;
+                    }
+                    hda.num_pending.fetch_sub(1);
+                }
+            } catch (...) {
+                hda.stop = true;
+                throw;
+            }
+        }
+
+        /** `top` cannot beat `best`, and the search would be optimal if
+         * `top` were the top of open (same bounds as `current_bounds`). */
+        bool hda_done_(FloatT best, FloatT top) const
+        {
+            if (std::isnan(best) || heuristic.cmp_open_score(top, best))
+                return false;
+            return is_optimal_(best, top < best ? best : top, top);
+        }
+
+        /** The tops of all workers are done (states in transit are not
+         * considered). */
+        bool hda_is_optimal_() const
+        {
+            const Hda& hda = *running_hda_;
+            FloatT best = hda.best.load();
+            if (std::isnan(best))
+                return false;
+            for (size_t i = 0; i < hda.size(); ++i)
+            {
+                FloatT top = hda.tops[i].load();
+                if (!std::isnan(top))
+                    return false;
+            }
+            return true;
+        }
+
+        /** Deliver the states in transit, gather the solutions and the
+         * statistics of the workers in the main search. */
+        void hda_finish_()
+        {
+            Hda& hda = *hda_;
+            for (size_t i = 0; i < hda.size(); ++i)
+            {
+                Search& w = hda_worker_(i);
+                w.running_hda_ = nullptr;
+                for (State& state : hda.inbox[i])
+                    w.push_local_(std::move(state));
+                hda.inbox[i].clear();
+            }
+
+            for (auto& w : hda.workers)
+            {
+                for (SolStatePair& sol : w->solutions_)
+                    solutions_.push_back(std::move(sol));
+                w->solutions_.clear();
+                num_steps += w->num_steps;
+                num_rejected_solutions += w->num_rejected_solutions;
+                num_rejected_states += w->num_rejected_states;
+                num_callback_calls += w->num_callback_calls;
+                sum_focal_size_ += w->sum_focal_size_;
+                w->num_steps = w->num_rejected_solutions = 0;
+                w->num_rejected_states = w->num_callback_calls = 0;
+            }
+            std::stable_sort(solutions_.begin(), solutions_.end(),
+                    [this](const SolStatePair& a, const SolStatePair& b) {
+                        return heuristic.cmp_open_score(a.state, b.state); });
+        }
+
+        /** Push `state` on the open list of its HDA* worker. */
         void push_(State&& state)
+        {
+            if (running_hda_ != nullptr)
+            {
+                Hda& hda = *running_hda_;
+                hda.num_pending.fetch_add(1);
+                size_t owner = static_cast<size_t>(inner::hash_box(state.box) % hda.size());
+                if (owner != worker_index_)
+                {
+                    std::lock_guard<std::mutex> lock(hda.inbox_mutex[owner]);
+                    hda.inbox[owner].push_back(std::move(state));
+                    return;
+                }
+            }
+            push_local_(std::move(state));
+        }
+
+        void push_local_(State&& state)
         {
             //size_t state_index = push_state_(std::move(state));
             auto cmp = [this](const State& a, const State& b) {
@@ -1361,6 +1850,14 @@ namespace veritas {
         return std::shared_ptr<VSearch>(new Search<MaxOutputHeuristic>(at));
     }
 
+    inline
+    std::shared_ptr<VSearch>
+    VSearch::max_output(std::shared_ptr<const PreparedEnsemble> prep)
+    {
+        return std::shared_ptr<VSearch>(new Search<MaxOutputHeuristic>(
+                    std::move(prep)));
+    }
+
     inline
     std::shared_ptr<VSearch>
     VSearch::min_dist_to_example(const AddTree& at,
@@ -1370,6 +1867,15 @@ namespace veritas {
                     at, example, output_threshold));
     }
 
+    inline
+    std::shared_ptr<VSearch>
+    VSearch::min_dist_to_example(std::shared_ptr<const PreparedEnsemble> prep,
+            const std::vector<FloatT>& example, FloatT output_threshold)
+    {
+        return std::shared_ptr<VSearch>(new Search<MinDistToExampleHeuristic>(
+                    std::move(prep), example, output_threshold));
+    }
+
 } // namespace veritas
 
 #endif // VERITAS_SEARCH_HPP
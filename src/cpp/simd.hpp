@@ -0,0 +1,74 @@
+/**
+ * \file simd.hpp
+ *
+ * Runtime detection of the SIMD instruction sets used by the vectorized
+ * kernels. Kernels are compiled with function-level target attributes, so
+ * the library itself does not need to be compiled with `-mavx2`.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_SIMD_HPP
+#define VERITAS_SIMD_HPP
+
+#include <iostream>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) \
+    && !defined(VERITAS_SIMD_DISABLED)
+#define VERITAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace veritas {
+
+    /** Instruction set used by the vectorized kernels. */
+    enum class SimdIsa {
+        SCALAR,
+        AVX2,
+        AVX512,
+    };
+
+    /** Does the CPU we are running on support `isa`? */
+    inline bool cpu_supports(SimdIsa isa)
+    {
+        switch (isa)
+        {
+        case SimdIsa::SCALAR:
+            return true;
+#ifdef VERITAS_X86_SIMD
+        case SimdIsa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SimdIsa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    /** The best instruction set supported by the CPU. */
+    inline SimdIsa detect_simd_isa()
+    {
+        if (cpu_supports(SimdIsa::AVX512)) return SimdIsa::AVX512;
+        if (cpu_supports(SimdIsa::AVX2)) return SimdIsa::AVX2;
+        return SimdIsa::SCALAR;
+    }
+
+    inline
+    std::ostream&
+    operator<<(std::ostream& strm, SimdIsa isa)
+    {
+        switch (isa)
+        {
+        case SimdIsa::SCALAR: return strm << "SCALAR";
+        case SimdIsa::AVX2:   return strm << "AVX2";
+        case SimdIsa::AVX512: return strm << "AVX512";
+        }
+        return strm;
+    }
+
+} // namespace veritas
+
+#endif // VERITAS_SIMD_HPP
@@ -0,0 +1,135 @@
+/**
+ * \file thread_pool.hpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_THREAD_POOL_HPP
+#define VERITAS_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * A fixed-size pool of worker threads executing submitted tasks.
+     *
+     * The first exception thrown by a task is rethrown by ThreadPool::wait.
+     */
+    class ThreadPool {
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable task_cv_;
+        std::condition_variable done_cv_;
+        size_t num_unfinished_ = 0;
+        bool stop_ = false;
+        std::exception_ptr error_;
+
+        void work_()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    task_cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                    if (tasks_.empty()) // stop_ is set
+                        return;
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+
+                std::exception_ptr error;
+                try { task(); }
+                catch (...) { error = std::current_exception(); }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (error && !error_)
+                    error_ = error;
+                if (--num_unfinished_ == 0)
+                    done_cv_.notify_all();
+            }
+        }
+
+    public:
+        /** Use `num_threads == 0` for one thread per hardware thread. */
+        explicit ThreadPool(size_t num_threads = 0)
+        {
+            if (num_threads == 0)
+                num_threads = std::max(1u, std::thread::hardware_concurrency());
+            workers_.reserve(num_threads);
+            for (size_t i = 0; i < num_threads; ++i)
+                workers_.emplace_back([this]() { work_(); });
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            task_cv_.notify_all();
+            for (std::thread& w : workers_)
+                w.join();
+        }
+
+        size_t num_threads() const { return workers_.size(); }
+
+        /** Schedule a task. */
+        void submit(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push_back(std::move(task));
+                ++num_unfinished_;
+            }
+            task_cv_.notify_one();
+        }
+
+        /** Block until all submitted tasks have finished. */
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [this]() { return num_unfinished_ == 0; });
+            if (error_)
+            {
+                std::exception_ptr error = error_;
+                error_ = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+
+        /**
+         * Call `f(i0, i1)` for consecutive ranges [i0, i1) of at most
+         * `chunk_size` elements covering [begin, end), and wait for them to
+         * finish.
+         */
+        template <typename F>
+        void parallel_for(size_t begin, size_t end, size_t chunk_size, const F& f)
+        {
+            chunk_size = std::max<size_t>(1, chunk_size);
+            for (size_t i0 = begin; i0 < end; i0 += chunk_size)
+            {
+                size_t i1 = std::min(end, i0 + chunk_size);
+                submit([&f, i0, i1]() { f(i0, i1); });
+            }
+            wait();
+        }
+    }; // ThreadPool
+
+} // namespace veritas
+
+#endif // VERITAS_THREAD_POOL_HPP
@@ -7,9 +7,13 @@
 */
 
 #include "tree.hpp"
+#include "json.hpp"
+#include "thread_pool.hpp"
 #include <algorithm>
+#include <cmath>
 
 #include <iostream>
+#include <fstream>
 #include <stack>
 
 namespace veritas {
@@ -32,6 +36,45 @@ namespace veritas {
             return true;
         }
 
+        /* Collect the internal nodes at relative depth `depth` below `n`. */
+        static void
+        veb_frontier(Tree::ConstRef n, int depth, std::vector<Tree::ConstRef>& frontier)
+        {
+            if (n.is_leaf())
+                return;
+            if (depth == 0)
+            {
+                frontier.push_back(n);
+                return;
+            }
+            veb_frontier(n.left(), depth-1, frontier);
+            veb_frontier(n.right(), depth-1, frontier);
+        }
+
+        /* Append the internal nodes of the subtree of internal node `n` in
+         * van Emde Boas order. `height` is the number of levels of internal
+         * nodes of the subtree. */
+        template <typename HotFirst>
+        static void
+        veb_order(Tree::ConstRef n, int height, const HotFirst& hot_first,
+                std::vector<NodeId>& order)
+        {
+            if (height == 1)
+            {
+                order.push_back(n.id());
+                return;
+            }
+
+            int top = height / 2;
+            veb_order(n, top, hot_first, order);
+
+            std::vector<Tree::ConstRef> frontier;
+            veb_frontier(n, top, frontier);
+            std::stable_sort(frontier.begin(), frontier.end(), hot_first);
+            for (Tree::ConstRef m : frontier)
+                veb_order(m, height - top, hot_first, order);
+        }
+
     } // namespace inner
 
     template <typename RefT>
@@ -104,91 +147,142 @@ namespace veritas {
 
     template <typename RefT>
     void
-    NodeRef<RefT>::to_json(std::ostream& s, int depth) const
+    NodeRef<RefT>::to_json(JsonWriter& w, int depth) const
     {
-        if (is_leaf())
-        {
-            s << "{\"leaf_value\": " << leaf_value() << "}";
-        }
-        else
+        // non-recursive: (node, depth, state) frames, state 0: write split
+        // and "lt", 1: write "gteq", 2: close
+        struct Frame { NodeRef<inner::ConstRef> n; int depth; int state; };
+        std::vector<Frame> stack;
+        stack.push_back({to_const(), depth, 0});
+
+        while (!stack.empty())
         {
-            s << "{\"feat_id\": " << get_split().feat_id
-                << ", \"split_value\": " << get_split().split_value
-                << ',' << std::endl;
-            for (int i = 0; i <= depth; ++i) s << "  ";
-            s << "\"lt\": ";
-            left().to_json(s, depth+1);
-            s << ',' << std::endl;
-            for (int i = 0; i <= depth; ++i) s << "  ";
-            s << "\"gteq\": ";
-            right().to_json(s, depth+1);
-            s << std::endl;
-            for (int i = 0; i < depth; ++i) s << "  ";
-            s << '}';
+            Frame f = stack.back();
+            if (f.n.is_leaf())
+            {
+                w.raw("{\"leaf_value\": ").number(f.n.leaf_value()).raw('}');
+                stack.pop_back();
+                continue;
+            }
+
+            switch (f.state)
+            {
+            case 0:
+                w.raw("{\"feat_id\": ").number(f.n.get_split().feat_id)
+                    .raw(", \"split_value\": ").number(f.n.get_split().split_value)
+                    .raw(",\n").indent(f.depth+1).raw("\"lt\": ");
+                stack.back().state = 1;
+                stack.push_back({f.n.left(), f.depth+1, 0});
+                break;
+            case 1:
+                w.raw(",\n").indent(f.depth+1).raw("\"gteq\": ");
+                stack.back().state = 2;
+                stack.push_back({f.n.right(), f.depth+1, 0});
+                break;
+            default:
+                w.raw('\n').indent(f.depth).raw('}');
+                stack.pop_back();
+            }
         }
     }
 
+    template void NodeRef<inner::ConstRef>::to_json(JsonWriter&, int) const;
+    template void NodeRef<inner::MutRef>::to_json(JsonWriter&, int) const;
+
+    template <typename RefT>
+    void
+    NodeRef<RefT>::to_json(std::ostream& s, int depth) const
+    {
+        JsonWriter w(s);
+        to_json(w, depth);
+        w.flush();
+    }
+
     template void NodeRef<inner::ConstRef>::to_json(std::ostream&, int) const;
     template void NodeRef<inner::MutRef>::to_json(std::ostream&, int) const;
 
     template <typename RefT>
     template <typename T>
     std::enable_if_t<T::is_mut_type::value, void>
-    NodeRef<RefT>::from_json(std::istream& s)
+    NodeRef<RefT>::from_json(JsonReader& r)
     {
-        std::string buf;
-        FloatT leaf_value, split_value;
-        FeatId feat_id;
-        char c;
+        using Token = JsonReader::Token;
+
+        // non-recursive: the nodes whose object is open, the opening brace
+        // of this node is consumed when called from AddTree::from_json
+        struct Frame {
+            NodeRef<inner::MutRef> n;
+            FeatId feat_id;
+            FloatT split_value;
+            bool has_feat_id, has_split_value;
+        };
+        std::vector<Frame> stack;
+        stack.push_back({*this, 0, 0.0, false, false});
+
+        auto open_child = [&r, &stack](bool left) {
+            Frame& f = stack.back();
+            if (f.n.is_leaf())
+            {
+                if (!f.has_feat_id || !f.has_split_value)
+                    r.error("split before feat_id and split_value");
+                f.n.split({f.feat_id, f.split_value});
+            }
+            r.expect(Token::BEGIN_OBJECT);
+            NodeRef<inner::MutRef> child = left ? f.n.left() : f.n.right();
+            stack.push_back({child, 0, 0.0, false, false});
+        };
 
-        while (s.get(c))
+        while (!stack.empty())
         {
-            switch (c)
+            Token t = r.next();
+            if (t == Token::END_OBJECT)
+            {
+                stack.pop_back();
+                continue;
+            }
+            if (t != Token::STRING)
+                r.error("expected key");
+
+            Frame& f = stack.back();
+            const std::string& key = r.text();
+            if (key == "leaf_value")
+            {
+                r.expect(Token::VALUE);
+                f.n.set_leaf_value(r.float_value());
+            }
+            else if (key == "feat_id")
             {
-                case ' ':
-                case '\n':
-                case '{':
-                case ',':
-                    break;
-                case '"':
-                case '\'':
-                    buf.clear();
-                    while (s.get(c))
-                        if (c != '"') buf.push_back(c); else break;
-                    break;
-                case '}':
-                    goto the_end;
-                case ':':
-                    if (buf == "feat_id")
-                        s >> feat_id;
-                    else if (buf == "split_value")
-                        s >> split_value;
-                    else if (buf == "leaf_value")
-                    {
-                        s >> leaf_value;
-                        set_leaf_value(leaf_value);
-                    }
-                    else if (buf == "lt") // left branch
-                    {
-                        split({feat_id, split_value});
-                        left().from_json(s);
-                    }
-                    else if (buf == "gteq") // expected after lt (split already applied)
-                    {
-                        right().from_json(s);
-                    }
-                    else
-                        throw std::runtime_error("tree parse error: unknown key");
-                    break;
-                default:
-                    throw std::runtime_error("tree parse error: unexpected char");
+                r.expect(Token::VALUE);
+                f.feat_id = r.int_value();
+                f.has_feat_id = true;
             }
+            else if (key == "split_value")
+            {
+                r.expect(Token::VALUE);
+                f.split_value = r.float_value();
+                f.has_split_value = true;
+            }
+            else if (key == "lt") // left branch
+                open_child(true);
+            else if (key == "gteq") // right branch
+                open_child(false);
+            else
+                r.error("unknown key '" + key + "'");
         }
+    }
 
-        the_end: return;
+    template <typename RefT>
+    template <typename T>
+    std::enable_if_t<T::is_mut_type::value, void>
+    NodeRef<RefT>::from_json(std::istream& s)
+    {
+        JsonReader r(s);
+        r.expect(JsonReader::Token::BEGIN_OBJECT);
+        from_json(r);
     }
 
-    //template int NodeRef<inner::MutRef>::from_json(std::istream&);
+    template void NodeRef<inner::MutRef>::from_json<inner::MutRef>(std::istream&);
+    template void NodeRef<inner::MutRef>::from_json<inner::MutRef>(JsonReader&);
 
     template <typename RefT>
     FloatT
@@ -215,6 +309,14 @@ namespace veritas {
     Tree
     Tree::prune(BoxRef box) const
     {
+        // nothing to prune: share the storage
+        bool unchanged = true;
+        for (size_t i = 0; i < size_ && unchanged; ++i)
+            unchanged = node_ptr_[i].is_leaf() || box.overlaps(node_ptr_[i].split())
+                == (BoxRef::OVERLAPS_LEFT | BoxRef::OVERLAPS_RIGHT);
+        if (unchanged)
+            return *this;
+
         std::stack<ConstRef, std::vector<ConstRef>> stack1;
         std::stack<MutRef, std::vector<MutRef>> stack2;
 
@@ -292,11 +394,28 @@ namespace veritas {
     Tree
     Tree::limit_depth(int max_depth) const
     {
+        // no internal node at max_depth or deeper: share the storage
+        std::vector<int> depth(size_, 0);
+        bool unchanged = true;
+        for (size_t i = 0; i < size_ && unchanged; ++i)
+        {
+            if (i > 0) depth[i] = depth[parent_ptr_[i]] + 1;
+            unchanged = node_ptr_[i].is_leaf() || depth[i] < max_depth;
+        }
+        if (unchanged)
+            return *this;
+
+        // constant time subtree maxima for the cut nodes
+        Tree cached(*this);
+        if (!cached.has_minmax_cache())
+            cached.cache_minmax();
+        const Tree& self = cached;
+
         Tree new_tree;
 
         std::stack<std::tuple<ConstRef, MutRef, int>,
             std::vector<std::tuple<ConstRef, MutRef, int>>> stack;
-        stack.push({root(), new_tree.root(), 0});
+        stack.push({self.root(), new_tree.root(), 0});
 
         while (stack.size() != 0)
         {
@@ -352,27 +471,244 @@ namespace veritas {
     Tree
     Tree::negate_leaf_values() const
     {
-        Tree new_tree;
+        // -((±v) + c) == (∓v) + (-c), exactly
+        Tree new_tree(*this);
+        new_tree.leaf_negate_ = !leaf_negate_;
+        new_tree.leaf_offset_ = -leaf_offset_;
+        return new_tree;
+    }
 
-        std::stack<std::tuple<ConstRef, MutRef>,
-            std::vector<std::tuple<ConstRef, MutRef>>> stack;
-        stack.push({root(), new_tree.root()});
+    Tree
+    Tree::offset_leaf_values(FloatT offset) const
+    {
+        Tree new_tree(*this);
+        if (offset == 0.0)
+            return new_tree;
+        // two offsets cannot be combined exactly: apply the first one
+        if (leaf_offset_ != 0.0)
+            new_tree.make_mutable_();
+        new_tree.leaf_offset_ = offset;
+        return new_tree;
+    }
 
-        while (stack.size() != 0)
+    void
+    Tree::cache_minmax()
+    {
+        // children are stored after their parents
+        auto ranges = std::make_shared<std::vector<inner::LeafRange>>(size_);
+        std::vector<inner::LeafRange>& r = *ranges;
+        for (size_t i = size_; i-- > 0; )
         {
-            auto [n, m] = stack.top();
-            stack.pop();
+            const inner::Node& n = node_ptr_[i];
+            if (n.is_leaf())
+                r[i] = {n.value, n.value};
+            else
+                r[i] = {std::min(r[n.left].lo, r[n.left+1].lo),
+                        std::max(r[n.left].hi, r[n.left+1].hi)};
+        }
+        minmax_ = std::move(ranges);
+    }
 
-            if (n.is_internal())
+    std::vector<size_t>
+    Tree::compute_visit_counts(const data& d) const
+    {
+        std::vector<size_t> counts(size_, 0);
+        for (size_t i = 0; i < d.num_rows; ++i)
+        {
+            data row = d.row(i);
+            ConstRef n = root();
+            ++counts[n.id()];
+            while (n.is_internal())
             {
-                m.split(n.get_split());
-                stack.push({n.right(), m.right()});
-                stack.push({n.left(), m.left()});
+                n = n.get_split().test(row) ? n.left() : n.right();
+                ++counts[n.id()];
             }
-            else m.set_leaf_value(-n.leaf_value());
         }
+        return counts;
+    }
 
-        return new_tree;
+    std::vector<NodeId>
+    Tree::relayout(NodeLayout layout, const std::vector<size_t>& visit_counts)
+    {
+        if (!visit_counts.empty() && visit_counts.size() != size_)
+            throw std::runtime_error("invalid visit counts");
+
+        const Tree& self = *this;
+
+        // subtree sizes, children come after their parents
+        std::vector<size_t> sizes;
+        if (visit_counts.empty())
+        {
+            sizes.assign(size_, 1);
+            for (size_t i = size_; i > 1; --i)
+                sizes[parent_ptr_[i-1]] += sizes[i-1];
+        }
+
+        auto hotness = [&](ConstRef n) {
+            return visit_counts.empty() ? sizes[n.id()] : visit_counts[n.id()];
+        };
+        auto hot_first = [&](ConstRef a, ConstRef b) {
+            return hotness(a) > hotness(b);
+        };
+
+        // The order of the internal nodes determines the layout: the
+        // children of the k-th internal node are stored at 1+2k and 2+2k.
+        // A parent must come before its children.
+        std::vector<NodeId> order;
+        order.reserve(size_ / 2);
+        if (self.root().is_internal())
+        {
+            switch (layout)
+            {
+            case NodeLayout::BFS:
+                order.push_back(0);
+                for (size_t k = 0; k < order.size(); ++k)
+                {
+                    ConstRef n = self[order[k]];
+                    if (n.left().is_internal()) order.push_back(n.left().id());
+                    if (n.right().is_internal()) order.push_back(n.right().id());
+                }
+                break;
+            case NodeLayout::DFS_HOT: {
+                std::stack<ConstRef, std::vector<ConstRef>> stack;
+                stack.push(self.root());
+                while (!stack.empty())
+                {
+                    ConstRef n = stack.top();
+                    stack.pop();
+                    order.push_back(n.id());
+                    ConstRef hot = n.left(), cold = n.right();
+                    if (hot_first(cold, hot))
+                        std::swap(hot, cold);
+                    if (cold.is_internal()) stack.push(cold);
+                    if (hot.is_internal()) stack.push(hot);
+                }
+                break;
+            }
+            case NodeLayout::VEB: {
+                // height in levels of internal nodes
+                std::vector<int> height(size_, 0);
+                for (size_t i = size_; i > 0; --i) // children after parents
+                {
+                    ConstRef n = self[static_cast<NodeId>(i-1)];
+                    if (n.is_internal())
+                        height[i-1] = 1 + std::max(height[n.left().id()],
+                                                   height[n.right().id()]);
+                }
+                inner::veb_order(self.root(), height[0], hot_first, order);
+                break;
+            }
+            }
+        }
+
+        std::vector<NodeId> old_to_new(size_);
+        std::vector<NodeId> new_to_old(size_);
+        old_to_new[0] = 0;
+        new_to_old[0] = 0;
+        for (size_t k = 0; k < order.size(); ++k)
+        {
+            NodeId left = node_ptr_[order[k]].left;
+            NodeId new_left = static_cast<NodeId>(1 + 2*k);
+            old_to_new[left] = new_left;
+            old_to_new[left+1] = new_left + 1;
+            new_to_old[new_left] = left;
+            new_to_old[new_left+1] = left + 1;
+        }
+
+        std::vector<inner::Node> new_nodes;
+        std::vector<NodeId> new_parents;
+        new_nodes.reserve(size_);
+        new_parents.reserve(size_);
+        for (size_t i = 0; i < size_; ++i)
+        {
+            inner::Node node = node_ptr_[new_to_old[i]];
+            if (!node.is_leaf())
+                node.left = old_to_new[node.left];
+            new_nodes.push_back(node);
+            new_parents.push_back(old_to_new[parent_ptr_[new_to_old[i]]]);
+        }
+        // fresh storage, the leaf transform still applies to the values
+        auto storage = std::make_shared<inner::TreeStorage>();
+        storage->nodes = std::move(new_nodes);
+        storage->parents = std::move(new_parents);
+        storage_ = std::move(storage);
+        owner_.reset();
+        minmax_.reset();
+        sync_();
+
+        return old_to_new;
+    }
+
+    FloatT
+    le_split_value(double threshold)
+    {
+        constexpr FloatT inf = std::numeric_limits<FloatT>::infinity();
+        constexpr double max = std::numeric_limits<FloatT>::max();
+        if (std::isnan(threshold))
+            throw std::runtime_error("NaN threshold");
+
+        // f: the largest float not greater than threshold
+        FloatT f;
+        if (threshold >= max) f = std::numeric_limits<FloatT>::max();
+        else if (threshold < -max) f = -inf;
+        else
+        {
+            f = static_cast<FloatT>(threshold);
+            if (static_cast<double>(f) > threshold)
+                f = std::nextafter(f, -inf);
+        }
+        return std::nextafter(f, inf);
+    }
+
+    Tree
+    Tree::from_arrays(const TreeArrays& a)
+    {
+        if (a.num_nodes == 0)
+            throw std::runtime_error("from_arrays: no nodes");
+        if (a.num_nodes > static_cast<size_t>(std::numeric_limits<NodeId>::max()))
+            throw std::runtime_error("from_arrays: too many nodes");
+
+        Tree tree;
+        std::vector<inner::Node>& nodes = tree.storage_->nodes;
+        std::vector<NodeId>& parents = tree.storage_->parents;
+        nodes.reserve(a.num_nodes);
+        parents.reserve(a.num_nodes);
+
+        std::vector<std::pair<int64_t, NodeId>> stack; // (array index, node id)
+        stack.push_back({0, 0});
+        size_t count = 0;
+        while (!stack.empty())
+        {
+            auto [i, id] = stack.back();
+            stack.pop_back();
+            if (i < 0 || static_cast<size_t>(i) >= a.num_nodes || ++count > a.num_nodes)
+                throw std::runtime_error("from_arrays: invalid tree structure");
+
+            if (a.left[i] == -1)
+            {
+                nodes[id].value = static_cast<FloatT>(a.value[i]);
+                continue;
+            }
+
+            int64_t feat_id = a.feature[i];
+            if (feat_id < 0 || feat_id > std::numeric_limits<FeatId>::max())
+                throw std::runtime_error("from_arrays: invalid feature");
+            NodeId left = static_cast<NodeId>(nodes.size());
+            inner::Node& n = nodes[id];
+            n.feat_id = static_cast<FeatId>(feat_id);
+            n.value = a.threshold_le ? le_split_value(a.threshold[i])
+                                     : static_cast<FloatT>(a.threshold[i]);
+            n.left = left;
+            nodes.emplace_back();
+            nodes.emplace_back();
+            parents.push_back(id);
+            parents.push_back(id);
+
+            stack.push_back({a.right[i], left + 1});
+            stack.push_back({a.left[i], left});
+        }
+        tree.sync_();
+        return tree;
     }
 
     std::ostream&
@@ -456,31 +792,10 @@ namespace veritas {
         new_at.base_score = base_score;
         for (const Tree& tree : *this)
         {
-            Tree& new_tree = new_at.add_tree();
-            std::stack<Tree::ConstRef, std::vector<Tree::ConstRef>> stack1;
-            std::stack<Tree::MutRef, std::vector<Tree::MutRef>> stack2;
-            stack1.push(tree.root());
-            stack2.push(new_tree.root());
-
             FloatT offset = std::min<FloatT>(0.0, std::get<0>(tree.find_minmax_leaf_value()));
+            // leaf - offset == leaf + (-offset)
+            new_at.add_tree(tree.offset_leaf_values(-offset));
             new_at.base_score += offset;
-
-            while (stack1.size() > 0)
-            {
-                auto n1 = stack1.top(); stack1.pop();
-                auto n2 = stack2.top(); stack2.pop();
-                if (n1.is_internal())
-                {
-                    n2.split(n1.get_split());
-                    stack1.push(n1.right()); stack1.push(n1.left());
-                    stack2.push(n2.right()); stack2.push(n2.left());
-                }
-                else
-                {
-                    n2.set_leaf_value(n1.leaf_value() - offset);
-                }
-            }
-
         }
         //std::cout << "neutralize_negative_leaf_values: base_score "
         //    << base_score << " -> " << new_at.base_score << std::endl;
@@ -531,6 +846,38 @@ namespace veritas {
         return AddTree().concat_negated(*this);
     }
 
+    std::vector<std::vector<NodeId>>
+    AddTree::relayout(NodeLayout layout)
+    {
+        std::vector<std::vector<NodeId>> maps;
+        for (Tree& t : trees_)
+            maps.push_back(t.relayout(layout));
+        return maps;
+    }
+
+    std::vector<std::vector<NodeId>>
+    AddTree::relayout(NodeLayout layout, const data& calibration)
+    {
+        std::vector<std::vector<NodeId>> maps;
+        for (Tree& t : trees_)
+            maps.push_back(t.relayout(layout, t.compute_visit_counts(calibration)));
+        return maps;
+    }
+
+    void
+    AddTree::add_trees_from_arrays(const std::vector<TreeArrays>& arrays,
+            ThreadPool& pool)
+    {
+        std::vector<Tree> trees(arrays.size());
+        pool.parallel_for(0, arrays.size(), 1, [&](size_t i0, size_t i1) {
+            for (size_t i = i0; i < i1; ++i)
+                trees[i] = Tree::from_arrays(arrays[i]);
+        });
+        trees_.reserve(trees_.size() + trees.size());
+        for (Tree& t : trees)
+            trees_.push_back(std::move(t));
+    }
+
     std::ostream&
     operator<<(std::ostream& strm, const AddTree& at)
     {
@@ -540,77 +887,146 @@ namespace veritas {
     }
 
     void
-    AddTree::to_json(std::ostream& s) const
+    AddTree::to_json(JsonWriter& w) const
     {
-        s << "{\"base_score\": " << base_score
-            << ", \"trees\": [" << std::endl;
+        w.raw("{\"base_score\": ").number(base_score).raw(", \"trees\": [\n");
         auto it = begin();
         if (it != end())
-            (it++)->to_json(s);
+            (it++)->to_json(w);
         for (; it != end(); ++it)
         {
-            s << ',' << std::endl;
-            it->to_json(s);
+            w.raw(",\n");
+            it->to_json(w);
         }
-
-        s << "]}";
+        w.raw("]}");
     }
 
     void
-    AddTree::from_json(std::istream& s)
+    AddTree::to_json(std::ostream& s) const
     {
-        std::string buf;
-        char c;
-        Tree tree;
+        JsonWriter w(s);
+        to_json(w);
+        w.flush();
+    }
+
+    namespace inner {
+        static void
+        write_float_literal(std::ostream& s, FloatT v)
+        {
+            if (std::isnan(v))
+                s << "std::numeric_limits<float>::quiet_NaN()";
+            else if (std::isinf(v))
+                s << (v < 0 ? "-" : "") << "std::numeric_limits<float>::infinity()";
+            else
+                s << std::hexfloat << v << std::defaultfloat << 'f';
+        }
 
-        while (s.get(c))
+        static void
+        write_node_source(std::ostream& s, Tree::ConstRef n, int depth)
         {
-            switch (c)
+            std::string indent(4 * static_cast<size_t>(depth), ' ');
+            if (n.is_leaf())
             {
-                case ' ':
-                case '\n':
-                case ',':
-                case '{':
-                    break;
-                case '"':
-                case '\'':
-                    buf.clear();
-                    while (s.get(c))
-                        if (c != '"') buf.push_back(c); else break;
-                    break;
-                case ':':
-                    if (buf == "base_score")
-                        s >> base_score;
-                    else if (buf == "trees")
-                        goto loop2;
-                    else
-                        throw std::runtime_error("addtree parse error: unknown key");
-                    break;
-                default:
-                    throw std::runtime_error("addtree parse error: unexpected char");
+                s << indent << "return ";
+                write_float_literal(s, n.leaf_value());
+                s << ";\n";
+                return;
             }
+
+            // !(x < split) goes right, also for NaN, like LtSplit::test
+            LtSplit split = n.get_split();
+            s << indent << "if (x[" << split.feat_id << "*s] < ";
+            write_float_literal(s, split.split_value);
+            s << ") {\n";
+            write_node_source(s, n.left(), depth+1);
+            s << indent << "} else {\n";
+            write_node_source(s, n.right(), depth+1);
+            s << indent << "}\n";
+        }
+    } // namespace inner
+
+    void
+    AddTree::compile_to_source(std::ostream& s) const
+    {
+        static_assert(std::is_same_v<FloatT, float>, "generated code uses float");
+
+        s << "// Generated by veritas from an AddTree with " << size()
+            << " trees. Do not edit.\n"
+            << "#include <cstddef>\n"
+            << "#include <limits>\n\n"
+            << "namespace {\n";
+        for (size_t i = 0; i < size(); ++i)
+        {
+            s << "inline float tree_" << i << "(const float *x, std::size_t s) {\n";
+            inner::write_node_source(s, trees_[i].root(), 1);
+            s << "}\n";
         }
+        s << "} // namespace\n\n"
+            << "extern \"C\" {\n"
+            << "std::size_t veritas_num_trees() { return " << size() << "; }\n\n"
+            << "float veritas_eval(const float *x, std::size_t stride_col) {\n"
+            << "    float v = ";
+        inner::write_float_literal(s, base_score);
+        s << ";\n";
+        for (size_t i = 0; i < size(); ++i)
+            s << "    v += tree_" << i << "(x, stride_col);\n";
+        s << "    return v;\n"
+            << "}\n\n"
+            << "void veritas_eval_batch(const float *x, std::size_t num_rows,\n"
+            << "        std::size_t stride_row, std::size_t stride_col, float *out) {\n"
+            << "    for (std::size_t r = 0; r < num_rows; ++r)\n"
+            << "        out[r] = veritas_eval(x + r * stride_row, stride_col);\n"
+            << "}\n"
+            << "} // extern \"C\"\n";
+    }
+
+    void
+    AddTree::compile_to_source(const std::string& path) const
+    {
+        std::ofstream f(path);
+        if (!f)
+            throw std::runtime_error("cannot open " + path);
+        compile_to_source(f);
+        if (!f)
+            throw std::runtime_error("cannot write " + path);
+    }
+
+    void
+    AddTree::from_json(JsonReader& r)
+    {
+        using Token = JsonReader::Token;
 
-        loop2: while (s.get(c))
+        r.expect(Token::BEGIN_OBJECT);
+        for (Token t = r.next(); t != Token::END_OBJECT; t = r.next())
         {
-            switch (c)
+            if (t != Token::STRING)
+                r.error("expected key");
+            if (r.text() == "base_score")
             {
-                case ' ':
-                case ']':
-                case '}':
-                case '\n':
-                    break;
-                case '[':
-                case ',':
-                    tree.from_json(s);
-                    add_tree(std::move(tree));
-                    tree.clear();
-                    break;
-                default:
-                    throw std::runtime_error("addtree parse error (2): unexpected char");
+                r.expect(Token::VALUE);
+                base_score = r.float_value();
             }
+            else if (r.text() == "trees")
+            {
+                r.expect(Token::BEGIN_ARRAY);
+                for (t = r.next(); t != Token::END_ARRAY; t = r.next())
+                {
+                    if (t != Token::BEGIN_OBJECT)
+                        r.error("expected tree");
+                    add_tree().root().from_json(r);
+                }
+            }
+            else
+                r.error("unknown key '" + r.text() + "'");
         }
-    } 
+    }
+
+    void
+    AddTree::from_json(std::istream& s)
+    {
+        JsonReader r(s);
+        from_json(r);
+    }
 
     void
     AddTree::compute_box(Box& box, const std::vector<NodeId> node_ids) const
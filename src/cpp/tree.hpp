@@ -18,39 +18,47 @@
 #include <iostream>
 #include <numeric> // std::accumulate
 #include <unordered_map>
+#include <memory>
+#include <cstdint>
 
 namespace veritas {
 
     class Tree;
+    class JsonReader;
+    class JsonWriter;
+    class ThreadPool;
 
     namespace inner {
-        struct NodeLeaf { FloatT leaf_value; };
-        struct NodeInternal {
-            NodeId left; // right = left + 1;
-            LtSplit split;
-        };
-
+        /**
+         * Compact 12-byte node. Internal nodes store their split and the id
+         * of their left child; the right child is at `left + 1`. Leaf nodes
+         * have `feat_id == -1` and store their leaf value in `value`.
+         *
+         * The node id is the index in Tree's node vector, parents are kept
+         * in a side table, and subtree sizes are computed on demand.
+         */
         struct Node {
-            NodeId id;
-            NodeId parent; /* root has itself as parent */
-            int tree_size; /* size of tree w/ this node as root; tree_size==1 => leaf node */
+            FloatT value;   /* split value or leaf value */
+            FeatId feat_id; /* -1 for leaf nodes */
+            NodeId left;    /* right = left + 1; -1 for leaf nodes */
+
+            /** new leaf node */
+            inline Node() : value(0.0), feat_id(-1), left(-1) {}
 
-            union {
-                inner::NodeLeaf leaf;
-                inner::NodeInternal internal;
-            };
+            inline bool is_leaf() const { return feat_id < 0; }
+            inline LtSplit split() const { return {feat_id, value}; }
+        };
 
-            //inline Node() : id(-1), parent(-1), tree_size(-1) {}
+        static_assert(sizeof(Node) == 12, "compact node layout");
 
-            /** new leaf node */
-            inline Node(NodeId id, NodeId parent) : id(id), parent(parent), tree_size(1), leaf{} {}
-            inline Node(const Node& o) : id(o.id), parent(o.parent), tree_size(o.tree_size), leaf{}
-            {
-                if (o.is_leaf()) leaf = o.leaf;
-                else             internal = o.internal;
-            }
+        /** Minimum and maximum leaf value in a subtree. */
+        struct LeafRange { FloatT lo, hi; };
 
-            inline bool is_leaf() const { return tree_size == 1; }
+        /** Node storage of a Tree, shared between copies until one is
+         * modified. */
+        struct TreeStorage {
+            std::vector<Node> nodes;
+            std::vector<NodeId> parents; /* root has itself as parent */
         };
 
         struct ConstRef {
@@ -65,6 +73,42 @@ namespace veritas {
         };
     } // namespace inner
 
+    /**
+     * Order of the nodes of a Tree in memory, see Tree::relayout.
+     *
+     * The two children of a node are always stored next to each other and
+     * after their parent, so all layouts are valid trees.
+     */
+    enum class NodeLayout {
+        BFS,     /**< Breadth-first, level by level. */
+        DFS_HOT, /**< Depth-first, the most visited child first, so hot paths are contiguous. */
+        VEB,     /**< van Emde Boas: a top subtree of half the height, followed by the bottom subtrees, recursively. */
+    };
+
+    /**
+     * The split value `s` for which `x < s` holds for exactly the floats `x`
+     * with `x <= threshold`, with `threshold` in double precision (the test
+     * used by scikit-learn and LightGBM).
+     */
+    FloatT le_split_value(double threshold);
+
+    /**
+     * Borrowed node arrays of a tree in the layout of scikit-learn's
+     * `tree_` attribute. Node 0 is the root. Node `i` is a leaf with value
+     * `value[i]` if `left[i] == -1`. Otherwise, its children are `left[i]`
+     * and `right[i]`, and an instance goes left if `x[feature[i]] <=
+     * threshold[i]` (`threshold_le`) or `x[feature[i]] < threshold[i]`.
+     */
+    struct TreeArrays {
+        size_t num_nodes;
+        const int64_t *left;
+        const int64_t *right;
+        const int64_t *feature;
+        const double *threshold;
+        const double *value;
+        bool threshold_le = true;
+    };
+
 
 
 
@@ -94,11 +138,11 @@ namespace veritas {
         TreePtr tree_;
         NodeId node_id_;
 
-        inline const inner::Node& node() const { return tree_->nodes_[node_id_]; };
+        inline const inner::Node& node() const { return tree_->node_ptr_[node_id_]; };
 
         template <typename T=RefT>
         inline std::enable_if_t<T::is_mut_type::value, inner::Node&> node()
-        { return tree_->nodes_[node_id_]; }
+        { return tree_->mut_node_(node_id_); }
 
     public:
         inline NodeRef(TreePtr tree, NodeId node_id) : tree_(tree), node_id_(node_id) {}
@@ -110,7 +154,7 @@ namespace veritas {
         /** Convert this to a constant reference. */
         inline NodeRef<inner::ConstRef> to_const() const { return { tree_, node_id_ }; }
 
-        inline bool is_root() const { return node().parent == node().id; }
+        inline bool is_root() const { return node_id_ == 0; }
         inline bool is_leaf() const { return node().is_leaf(); }
         inline bool is_internal() const { return !is_leaf(); }
         inline bool is_left_child() const { return !is_root() && parent().left().id() == id(); }
@@ -122,23 +166,24 @@ namespace veritas {
         inline NodeRef<RefT> left() const
         {
             if (is_leaf()) throw std::runtime_error("left of leaf");
-            return { tree_, node().internal.left };
+            return { tree_, node().left };
         }
         /** Navigate to the right child. */
         inline NodeRef<RefT> right() const
         {
             if (is_leaf()) throw std::runtime_error("right of leaf");
-            return { tree_, node().internal.left + 1 };
+            return { tree_, node().left + 1 };
         }
         /** Navigate to the parent of this node. */
         inline NodeRef<RefT> parent() const
         {
             if (is_root()) throw std::runtime_error("parent of root");
-            return { tree_, node().parent };
+            return { tree_, tree_->parent_ptr_[node_id_] };
         }
 
-        /** Number of nodes in this (sub)tree. */
-        inline int tree_size() const { return node().tree_size; }
+        /** Number of nodes in this (sub)tree. Computed on demand. */
+        inline int tree_size() const
+        { return is_leaf() ? 1 : 1 + left().tree_size() + right().tree_size(); }
 
         /** Compute the depth of this node. */
         inline int depth() const
@@ -157,14 +202,14 @@ namespace veritas {
         inline LtSplit get_split() const
         {
             if (is_leaf()) throw std::runtime_error("get_split of leaf");
-            return node().internal.split;
+            return node().split();
         }
 
         /** Access the leaf value of this leaf node. */
         inline FloatT leaf_value() const
         {
             if (is_internal()) throw std::runtime_error("leaf_value of internal");
-            return node().leaf.leaf_value;
+            return tree_->leaf_value_(node().value);
         }
 
         /** Set the leaf value of this leaf node. */
@@ -173,7 +218,7 @@ namespace veritas {
         set_leaf_value(FloatT value)
         {
             if (is_internal()) throw std::runtime_error("set_leaf_value of internal");
-            node().leaf.leaf_value = value;
+            node().value = value;
         }
 
         /** Split this leaf node. */
@@ -183,24 +228,11 @@ namespace veritas {
         {
             if (is_internal()) throw std::runtime_error("split internal");
 
-            NodeId left_id = static_cast<NodeId>(tree_->nodes_.size());
-
-            inner::Node left(left_id,      id());
-            inner::Node right(left_id + 1, id());
-
-            tree_->nodes_.push_back(left);
-            tree_->nodes_.push_back(right);
+            NodeId left_id = tree_->append_children_(id());
 
-            node().internal.split = split;
-            node().internal.left = left_id;
-
-            node().tree_size = 3;
-            NodeRef n(*this);
-            while (!n.is_root())
-            {
-                n = n.parent();
-                n.node().tree_size += 2;
-            }
+            node().feat_id = split.feat_id;
+            node().value = split.split_value;
+            node().left = left_id;
         }
 
         /** Boolean split; uses LtSplit with BOOL_SPLIT_VALUE */
@@ -223,9 +255,12 @@ namespace veritas {
             return false;
         }
 
-        /** Returns the minimum and maximum leaf value in this (sub)tree. */
+        /** Returns the minimum and maximum leaf value in this (sub)tree.
+         * Constant time if the tree has a cache, see Tree::cache_minmax. */
         std::tuple<FloatT, FloatT> find_minmax_leaf_value() const
         {
+            if (tree_->minmax_)
+                return tree_->leaf_range_(node_id_);
             if (is_internal())
             {
                 auto &&[lm, lM] = left().find_minmax_leaf_value();
@@ -260,12 +295,22 @@ namespace veritas {
         bool compute_box(Box& box) const;
 
         void print_node(std::ostream& strm, int depth) const;
+        /** Write this subtree as JSON, without recursion. Floats are
+         * written exactly. */
         void to_json(std::ostream& strm, int depth) const;
+        /** See NodeRef::to_json(std::ostream&, int) */
+        void to_json(JsonWriter& w, int depth) const;
 
         template <typename T=RefT>
         std::enable_if_t<T::is_mut_type::value, void>
         from_json(std::istream& strm);
 
+        /** Parse the remainder of a JSON node object, without recursion. The
+         * opening brace has already been read. */
+        template <typename T=RefT>
+        std::enable_if_t<T::is_mut_type::value, void>
+        from_json(JsonReader& r);
+
         FloatT eval(const data& data) const;
         NodeId eval_node(const data& data) const;
     }; // NodeRef
@@ -275,6 +320,11 @@ namespace veritas {
 
     /**
      * A binary decision tree with less-than splits.
+     *
+     * Copying a tree is cheap: copies share the node storage until one of
+     * them is modified (copy-on-write). Negating or offsetting the leaf
+     * values is stored as a per-tree leaf transform instead of rewriting
+     * the nodes.
      */
     class Tree {
     public:
@@ -284,11 +334,135 @@ namespace veritas {
     private:
         friend ConstRef;
         friend MutRef;
+        friend class AddTree;
+
+        // The storage in use: `storage_`, which is shared by copies of this
+        // tree until one of them is modified, or read-only external memory
+        // (e.g. a memory-mapped file) kept alive by `owner_`. Modifying a
+        // tree copies shared or external storage first.
+        std::shared_ptr<inner::TreeStorage> storage_;
+        const inner::Node *node_ptr_;
+        const NodeId *parent_ptr_;
+        size_t size_;
+        std::shared_ptr<const void> owner_;
+
+        // Affine leaf transform: leaf value = (negate ? -v : v) + offset for
+        // the stored value v. Applied to the storage on the first mutation.
+        bool leaf_negate_ = false;
+        FloatT leaf_offset_ = 0.0;
+
+        // Optional subtree leaf ranges, indexed by NodeId, before the leaf
+        // transform. Shared by copies, dropped on mutation.
+        std::shared_ptr<const std::vector<inner::LeafRange>> minmax_;
+
+        inline void sync_()
+        {
+            node_ptr_ = storage_->nodes.data();
+            parent_ptr_ = storage_->parents.data();
+            size_ = storage_->nodes.size();
+        }
 
-        std::vector<inner::Node> nodes_;
+        /** Get private, transform-free storage before a mutation. */
+        inline void make_mutable_()
+        {
+            minmax_.reset();
+            bool owned = storage_ && storage_.use_count() == 1;
+            if (owned && !has_leaf_transform())
+                return;
+            if (!owned)
+            {
+                auto s = std::make_shared<inner::TreeStorage>();
+                s->nodes.assign(node_ptr_, node_ptr_ + size_);
+                s->parents.assign(parent_ptr_, parent_ptr_ + size_);
+                storage_ = std::move(s);
+                owner_.reset();
+            }
+            if (has_leaf_transform())
+            {
+                for (inner::Node& n : storage_->nodes)
+                    if (n.is_leaf())
+                        n.value = leaf_value_(n.value);
+                leaf_negate_ = false;
+                leaf_offset_ = 0.0;
+            }
+            sync_();
+        }
+
+        inline inner::Node& mut_node_(NodeId id)
+        {
+            make_mutable_();
+            return storage_->nodes[id];
+        }
+
+        /** Append two leaf children of `parent`, return the left id. */
+        inline NodeId append_children_(NodeId parent)
+        {
+            make_mutable_();
+            NodeId left_id = static_cast<NodeId>(storage_->nodes.size());
+            storage_->nodes.emplace_back();
+            storage_->nodes.emplace_back();
+            storage_->parents.push_back(parent);
+            storage_->parents.push_back(parent);
+            sync_();
+            return left_id;
+        }
+
+        /** Apply the leaf transform to a stored leaf value. */
+        inline FloatT leaf_value_(FloatT v) const
+        {
+            FloatT x = leaf_negate_ ? -v : v;
+            return leaf_offset_ == 0.0 ? x : x + leaf_offset_;
+        }
+
+        /** Cached leaf range of subtree `id`, with the leaf transform. */
+        inline std::tuple<FloatT, FloatT> leaf_range_(NodeId id) const
+        {
+            inner::LeafRange r = (*minmax_)[id];
+            if (leaf_negate_) std::swap(r.lo, r.hi);
+            return {leaf_value_(r.lo), leaf_value_(r.hi)};
+        }
+
+        /** Leave a moved-from tree empty. */
+        inline void release_()
+        {
+            storage_.reset(); owner_.reset(); minmax_.reset();
+            node_ptr_ = nullptr; parent_ptr_ = nullptr; size_ = 0;
+            leaf_negate_ = false; leaf_offset_ = 0.0;
+        }
+
+        /** Read-only view on `size` nodes and parents in external memory. */
+        inline Tree(const inner::Node *nodes, const NodeId *parents, size_t size,
+                std::shared_ptr<const void> owner)
+            : node_ptr_(nodes), parent_ptr_(parents), size_(size)
+            , owner_(std::move(owner)) {}
 
     public:
         inline Tree() { clear(); }
+        /** Copies share the node storage until one of them is modified. */
+        inline Tree(const Tree& o) = default;
+        inline Tree(Tree&& o) noexcept
+            : storage_(std::move(o.storage_))
+            , node_ptr_(o.node_ptr_), parent_ptr_(o.parent_ptr_), size_(o.size_)
+            , owner_(std::move(o.owner_))
+            , leaf_negate_(o.leaf_negate_), leaf_offset_(o.leaf_offset_)
+            , minmax_(std::move(o.minmax_))
+        { o.release_(); }
+        inline Tree& operator=(const Tree& o) = default;
+        inline Tree& operator=(Tree&& o) noexcept
+        {
+            if (this == &o) return *this;
+            storage_ = std::move(o.storage_);
+            node_ptr_ = o.node_ptr_;
+            parent_ptr_ = o.parent_ptr_;
+            size_ = o.size_;
+            owner_ = std::move(o.owner_);
+            leaf_negate_ = o.leaf_negate_;
+            leaf_offset_ = o.leaf_offset_;
+            minmax_ = std::move(o.minmax_);
+            o.release_();
+            return *this;
+        }
+
         /** Const NodeRef to root node */
         inline ConstRef root() const { return (*this)[0]; }
         /** Const NodeRef to root node */
@@ -298,7 +472,30 @@ namespace veritas {
         /** Mutable NodeRef to root node */
         inline MutRef root_mut() { return (*this)[0]; }
         /** Reset this tree. */
-        inline void clear() { nodes_.clear(); nodes_.push_back({0, 0}); }
+        inline void clear()
+        {
+            owner_.reset();
+            storage_ = std::make_shared<inner::TreeStorage>();
+            storage_->nodes.emplace_back();
+            storage_->parents.push_back(0);
+            leaf_negate_ = false;
+            leaf_offset_ = 0.0;
+            minmax_.reset();
+            sync_();
+        }
+
+        /** Is this tree a read-only view on external memory? It is copied
+         * on the first mutation. See AddTree::map_binary. */
+        inline bool is_view() const { return static_cast<bool>(owner_); }
+        /** Does this tree share its node storage with another tree? */
+        inline bool is_shared() const { return owner_ || storage_.use_count() > 1; }
+
+        /** Are the stored leaf values transformed when read? See
+         * Tree::negate_leaf_values and Tree::offset_leaf_values. */
+        inline bool has_leaf_transform() const
+        { return leaf_negate_ || leaf_offset_ != 0.0; }
+        /** The leaf value for stored value `v` in Tree::node_data. */
+        inline FloatT transform_leaf_value(FloatT v) const { return leaf_value_(v); }
 
         /** Get a const NodeRef to node with given id. */
         inline ConstRef operator[] (NodeId id) const { return { *this, id }; }
@@ -307,7 +504,7 @@ namespace veritas {
 
         /** Bounds check the given node id. */
         inline bool is_valid_node_id(NodeId id) const
-        { return id >= 0 && static_cast<size_t>(id) < nodes_.size(); }
+        { return id >= 0 && static_cast<size_t>(id) < size_; }
 
         /** Bounds check the given node id, throw error if invalid. */
         inline void check_node_id(NodeId id) const
@@ -332,23 +529,69 @@ namespace veritas {
         }
 
         inline size_t num_leafs() const { return root().num_leafs(); }
-        inline size_t num_nodes() const { return static_cast<size_t>(root().tree_size()); }
+        inline size_t num_nodes() const { return size_; }
+
+        /** The nodes, indexed by NodeId. Invalidated by any mutation of
+         * the tree. Leaf values are stored before the leaf transform, see
+         * Tree::transform_leaf_value. */
+        inline const inner::Node *node_data() const { return node_ptr_; }
+        /** The parent of each node, indexed by NodeId (the root is its own
+         * parent). Invalidated by any mutation of the tree. */
+        inline const NodeId *parent_data() const { return parent_ptr_; }
+        /** Keeps the memory of Tree::node_data and Tree::parent_data alive.
+         * While it is held, the tree counts as shared and copies its
+         * storage before the next mutation, so that memory is never
+         * modified or freed. */
+        inline std::shared_ptr<const void> data_owner() const
+        { return owner_ ? owner_ : std::shared_ptr<const void>(storage_); }
 
         inline void to_json(std::ostream& strm) const { root().to_json(strm, 0); }
+        inline void to_json(JsonWriter& w) const { root().to_json(w, 0); }
         inline void from_json(std::istream& strm) { root().from_json(strm); };
 
         /** Prune all branches that are never taken for examples in the given box. */
         Tree prune(BoxRef box) const;
         /** See NodeRef::find_minmax_leaf_value */
         std::tuple<FloatT, FloatT> find_minmax_leaf_value() const { return root().find_minmax_leaf_value(); }
+        /**
+         * Compute the minimum and maximum leaf value of every subtree in one
+         * bottom-up pass, and cache them until the tree is modified. Makes
+         * NodeRef::find_minmax_leaf_value constant time, which lets
+         * traversals skip subtrees that cannot beat a bound (see
+         * LeafIter::next(FloatT)).
+         */
+        void cache_minmax();
+        /** Are subtree leaf ranges cached? See Tree::cache_minmax. */
+        inline bool has_minmax_cache() const { return static_cast<bool>(minmax_); }
         /** See NodeRef::get_leaf_ids */
         std::vector<NodeId> get_leaf_ids() const { return root().get_leaf_ids(); }
         /** Limit depth and replace leaf values with max leaf value in subtree. */
         Tree limit_depth(int max_depth) const;
         /** Compute the variance of the leaf values */
         FloatT leaf_value_variance() const;
-        /** Construct a new tree with negated leaf values. */
+        /** A tree with negated leaf values. Shares the node storage with
+         * this tree, the negation is part of the leaf transform. */
         Tree negate_leaf_values() const;
+        /** A tree with `offset` added to the leaf values. Shares the node
+         * storage with this tree, unless it already has an offset. */
+        Tree offset_leaf_values(FloatT offset) const;
+
+        /** Build a tree from node arrays in one pass. The nodes are
+         * renumbered depth-first, left child first. See ::TreeArrays. */
+        static Tree from_arrays(const TreeArrays& arrays);
+
+        /** Count the number of rows in `d` that visit each node. Indexed by
+         * NodeId. */
+        std::vector<size_t> compute_visit_counts(const data& d) const;
+        /**
+         * Renumber the nodes of this tree in the given layout. Nodes are
+         * ordered by `visit_counts` (see Tree::compute_visit_counts) when
+         * given, or by subtree size otherwise. The root keeps id 0.
+         *
+         * Returns the mapping from old to new node ids.
+         */
+        std::vector<NodeId> relayout(NodeLayout layout,
+                const std::vector<size_t>& visit_counts = {});
 
         /** Evaluate this tree on an instance. */
         FloatT eval(const data& row) const { return root().eval(row); }
@@ -364,7 +607,8 @@ namespace veritas {
 
 
 
-    /** Additive ensemble of Trees. A sum of Trees. */
+    /** Additive ensemble of Trees. A sum of Trees. Copying an AddTree
+     * does not copy the node storage of the trees, see Tree. */
     class AddTree {
     public:
         using const_iterator = std::vector<Tree>::const_iterator;
@@ -373,6 +617,11 @@ namespace veritas {
     private:
         std::vector<Tree> trees_;
 
+        /** Use the binary model in `fd` as storage, closes `fd`. Returns
+         * false, without changing this, if the model is in the other byte
+         * order. */
+        bool map_fd_(int fd, const std::string& what);
+
     public:
         FloatT base_score; /**< Constant value added to the output of the ensemble. */
         inline AddTree() : base_score{0.0} {} ;
@@ -393,6 +642,13 @@ namespace veritas {
         inline void add_tree(Tree&& t) { trees_.emplace_back(std::move(t)); }
         /** Add a tree to the ensemble. */
         inline void add_tree(const Tree& t) { trees_.push_back(t); }
+        /** Add a tree built from node arrays, see Tree::from_arrays. */
+        inline Tree& add_tree_from_arrays(const TreeArrays& arrays)
+        { return trees_.emplace_back(Tree::from_arrays(arrays)); }
+        /** Add a tree for each element of `arrays`, building the trees in
+         * parallel on the threads of `pool`. */
+        void add_trees_from_arrays(const std::vector<TreeArrays>& arrays,
+                ThreadPool& pool);
 
         /** Get mutable reference to tree `i` */
         inline Tree& operator[](size_t i) { return trees_[i]; }
@@ -432,8 +688,73 @@ namespace veritas {
         /** Negate the leaf values of all trees. See Tree::negate_leaf_values. */
         AddTree negate_leaf_values() const;
 
+        /** Renumber the nodes of all trees, see Tree::relayout. Returns the
+         * old to new node id mapping of each tree. */
+        std::vector<std::vector<NodeId>> relayout(NodeLayout layout);
+        /** Like AddTree::relayout(NodeLayout), but order the nodes by the
+         * number of rows in `calibration` that visit them. */
+        std::vector<std::vector<NodeId>> relayout(NodeLayout layout,
+                const data& calibration);
+
         void to_json(std::ostream& strm) const;
+        void to_json(JsonWriter& w) const;
+        /** Parse a JSON model. Reads ahead in `strm`. */
         void from_json(std::istream& strm);
+        /** Parse a JSON model from a streaming reader, with bounded stack
+         * and buffer use. */
+        void from_json(JsonReader& r);
+
+        /**
+         * Emit a self-contained C++ translation unit that evaluates this
+         * ensemble with nested if/else blocks. The unit exports the C
+         * functions `veritas_num_trees`, `veritas_eval` and
+         * `veritas_eval_batch`. See NativePredictor to build and load it.
+         *
+         * Literals are written as hexadecimal floats and the trees are
+         * summed in the same order as AddTree::eval, so the output is
+         * bit-exact.
+         */
+        void compile_to_source(std::ostream& strm) const;
+        /** Like AddTree::compile_to_source(std::ostream&), but write to a file. */
+        void compile_to_source(const std::string& path) const;
+
+        /**
+         * Write the ensemble in the versioned binary format: a header,
+         * a table with the node offset of each tree, and the contiguous
+         * node and parent arrays of all trees, 16-byte aligned, in native
+         * byte order.
+         */
+        void to_binary(std::ostream& strm) const;
+        /** Like AddTree::to_binary(std::ostream&), but write to a file. */
+        void to_binary(const std::string& path) const;
+        /** Read the binary format into a new, mutable copy. Files written
+         * with the other byte order are converted. */
+        void from_binary(std::istream& strm);
+        /**
+         * Memory-map a binary file and use it as read-only storage for the
+         * trees, without deserializing. Processes that map the same file
+         * share its pages. A tree is copied on its first mutation, see
+         * Tree::is_view. Falls back to AddTree::from_binary when mapping
+         * is not possible (other byte order, no mmap support).
+         */
+        void map_binary(const std::string& path);
+
+        /**
+         * Place the ensemble in a new POSIX shared memory segment `name`
+         * (e.g. "/my-model"), in the binary format. Throws if the segment
+         * already exists. The segment outlives this process until
+         * AddTree::unlink_shared_memory.
+         */
+        void to_shared_memory(const std::string& name) const;
+        /**
+         * Attach to a segment created by AddTree::to_shared_memory, like
+         * AddTree::map_binary: the trees are read-only views on the shared
+         * pages, so all attached processes share a single copy.
+         */
+        void attach_shared_memory(const std::string& name);
+        /** Remove a shared memory segment. Processes that are attached
+         * keep their mapping. */
+        static void unlink_shared_memory(const std::string& name);
 
         /** Evaluate the ensemble. This is the sum of the evaluations of the
          * trees. See Tree::eval. */
@@ -0,0 +1,280 @@
+/**
+ * \file xgb.cpp
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#include "xgb.hpp"
+#include "json.hpp"
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <stack>
+#include <stdexcept>
+
+namespace veritas {
+
+    namespace inner {
+        using Token = JsonReader::Token;
+
+        template <typename Reader>
+        static void
+        skip_value(Reader& r, Token t)
+        {
+            if (t != Token::BEGIN_OBJECT && t != Token::BEGIN_ARRAY)
+                return;
+            for (int depth = 1; depth > 0; )
+            {
+                t = r.next();
+                if (t == Token::BEGIN_OBJECT || t == Token::BEGIN_ARRAY) ++depth;
+                else if (t == Token::END_OBJECT || t == Token::END_ARRAY) --depth;
+                else if (t == Token::END) r.error("unexpected end of input");
+            }
+        }
+
+        /** Iterate over the keys of an object whose opening brace has been
+         * read, `f(key)` must consume the value. */
+        template <typename Reader, typename F>
+        static void
+        for_each_remaining_key(Reader& r, const F& f)
+        {
+            for (Token t = r.next(); t != Token::END_OBJECT; t = r.next())
+            {
+                if (t != Token::STRING)
+                    r.error("expected key");
+                std::string key = r.text();
+                f(key);
+            }
+        }
+
+        template <typename Reader, typename F>
+        static void
+        for_each_key(Reader& r, const F& f)
+        {
+            r.expect(Token::BEGIN_OBJECT);
+            for_each_remaining_key(r, f);
+        }
+
+        template <typename Reader, typename T, typename Get>
+        static void
+        read_array(Reader& r, std::vector<T>& out, const Get& get)
+        {
+            out.clear();
+            r.expect(Token::BEGIN_ARRAY);
+            for (Token t = r.next(); t != Token::END_ARRAY; t = r.next())
+            {
+                if (t != Token::VALUE)
+                    r.error("expected number");
+                out.push_back(get());
+            }
+        }
+
+        /** XGBoost stores some numbers as strings, e.g. "5E-1" or "[5E-1]". */
+        template <typename Reader>
+        static double
+        read_string_number(Reader& r)
+        {
+            Token t = r.next();
+            if (t == Token::VALUE)
+                return r.float_value();
+            if (t != Token::STRING)
+                r.error("expected number");
+            std::string s = r.text();
+            size_t b = s.find_first_not_of("[ ");
+            size_t e = s.find_last_not_of("] ");
+            if (b == std::string::npos)
+                r.error("expected number");
+            double v;
+            auto [ptr, ec] = std::from_chars(s.data() + b, s.data() + e + 1, v);
+            if (ec != std::errc() || ptr != s.data() + e + 1)
+                r.error("invalid number '" + s + "'");
+            return v;
+        }
+
+        template <typename Reader>
+        static std::string
+        read_string(Reader& r)
+        {
+            if (r.next() != Token::STRING)
+                r.error("expected string");
+            return r.text();
+        }
+
+        /** Read a tree object, the opening brace has been read. */
+        template <typename Reader>
+        static Tree
+        read_xgb_tree(Reader& r)
+        {
+            std::vector<int> left, right, split_index, split_type;
+            std::vector<FloatT> split_cond;
+
+            auto get_int = [&r]() { return r.int_value(); };
+            auto get_float = [&r]() { return r.float_value(); };
+
+            for_each_remaining_key(r, [&](const std::string& key) {
+                if (key == "left_children") read_array(r, left, get_int);
+                else if (key == "right_children") read_array(r, right, get_int);
+                else if (key == "split_indices") read_array(r, split_index, get_int);
+                else if (key == "split_conditions") read_array(r, split_cond, get_float);
+                else if (key == "split_type") read_array(r, split_type, get_int);
+                else skip_value(r, r.next());
+            });
+
+            size_t num_nodes = left.size();
+            if (num_nodes == 0 || right.size() != num_nodes
+                    || split_index.size() != num_nodes
+                    || split_cond.size() != num_nodes)
+                r.error("inconsistent tree arrays");
+            for (int type : split_type)
+                if (type != 0)
+                    throw std::runtime_error("xgb: categorical splits not supported");
+
+            // XGBoost: yes (left) if x < split_condition; the leaf value of
+            // a leaf is stored in split_conditions
+            Tree tree;
+            std::stack<std::pair<int, Tree::MutRef>,
+                std::vector<std::pair<int, Tree::MutRef>>> stack;
+            stack.push({0, tree.root()});
+            size_t count = 0;
+            while (!stack.empty())
+            {
+                auto [nid, n] = stack.top();
+                stack.pop();
+                if (nid < 0 || static_cast<size_t>(nid) >= num_nodes
+                        || ++count > num_nodes)
+                    r.error("invalid tree structure");
+
+                if (left[nid] == -1)
+                {
+                    n.set_leaf_value(split_cond[nid]);
+                }
+                else
+                {
+                    n.split({split_index[nid], split_cond[nid]});
+                    stack.push({right[nid], n.right()});
+                    stack.push({left[nid], n.left()});
+                }
+            }
+            return tree;
+        }
+
+        /** Transform XGBoost's base_score to a margin, see ObjFunction::ProbToMargin. */
+        static FloatT
+        base_margin(const std::string& objective, double base_score)
+        {
+            if (objective == "binary:logistic" || objective == "reg:logistic"
+                    || objective == "binary:logitraw")
+                return static_cast<FloatT>(-std::log(1.0 / base_score - 1.0));
+            if (objective == "count:poisson" || objective == "reg:gamma"
+                    || objective == "reg:tweedie" || objective == "survival:cox"
+                    || objective == "survival:aft")
+                return static_cast<FloatT>(std::log(base_score));
+            return static_cast<FloatT>(base_score);
+        }
+
+        template <typename Reader>
+        static std::vector<AddTree>
+        read_xgb_model(Reader& r)
+        {
+            std::vector<Tree> trees;
+            std::vector<int> tree_info;
+            double base_score = 0.5;
+            int num_class = 0;
+            std::string objective, booster = "gbtree";
+            auto get_int = [&r]() { return r.int_value(); };
+
+            auto read_gbtree_model = [&]() {
+                for_each_key(r, [&](const std::string& key) {
+                    if (key == "trees")
+                    {
+                        r.expect(Token::BEGIN_ARRAY);
+                        for (Token t = r.next(); t != Token::END_ARRAY; t = r.next())
+                        {
+                            if (t != Token::BEGIN_OBJECT)
+                                r.error("expected tree");
+                            trees.push_back(read_xgb_tree(r));
+                        }
+                    }
+                    else if (key == "tree_info") read_array(r, tree_info, get_int);
+                    else skip_value(r, r.next());
+                });
+            };
+
+            for_each_key(r, [&](const std::string& key) {
+                if (key != "learner") { skip_value(r, r.next()); return; }
+                for_each_key(r, [&](const std::string& key) {
+                    if (key == "gradient_booster")
+                    {
+                        for_each_key(r, [&](const std::string& key) {
+                            if (key == "model") read_gbtree_model();
+                            else if (key == "name") booster = read_string(r);
+                            else skip_value(r, r.next());
+                        });
+                    }
+                    else if (key == "learner_model_param")
+                    {
+                        for_each_key(r, [&](const std::string& key) {
+                            if (key == "base_score") base_score = read_string_number(r);
+                            else if (key == "num_class")
+                                num_class = static_cast<int>(read_string_number(r));
+                            else skip_value(r, r.next());
+                        });
+                    }
+                    else if (key == "objective")
+                    {
+                        for_each_key(r, [&](const std::string& key) {
+                            if (key == "name") objective = read_string(r);
+                            else skip_value(r, r.next());
+                        });
+                    }
+                    else skip_value(r, r.next());
+                });
+            });
+
+            if (booster != "gbtree")
+                throw std::runtime_error("xgb: unsupported booster " + booster);
+            if (!tree_info.empty() && tree_info.size() != trees.size())
+                throw std::runtime_error("xgb: tree_info does not match trees");
+
+            size_t num_groups = static_cast<size_t>(std::max(1, num_class));
+            std::vector<AddTree> ats(num_groups);
+            for (AddTree& at : ats)
+                at.base_score = base_margin(objective, base_score);
+            for (size_t i = 0; i < trees.size(); ++i)
+            {
+                size_t group = tree_info.empty() ? 0 : static_cast<size_t>(tree_info[i]);
+                if (group >= num_groups)
+                    throw std::runtime_error("xgb: invalid tree_info");
+                ats[group].add_tree(std::move(trees[i]));
+            }
+            return ats;
+        }
+    } // namespace inner
+
+    std::vector<AddTree>
+    addtrees_from_xgb_json(std::istream& strm)
+    {
+        JsonReader r(strm);
+        return inner::read_xgb_model(r);
+    }
+
+    std::vector<AddTree>
+    addtrees_from_xgb_ubjson(std::istream& strm)
+    {
+        UbjsonReader r(strm);
+        return inner::read_xgb_model(r);
+    }
+
+    std::vector<AddTree>
+    addtrees_from_xgb_file(const std::string& path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        if (!f)
+            throw std::runtime_error("cannot open " + path);
+        bool ubj = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ubj") == 0;
+        return ubj ? addtrees_from_xgb_ubjson(f) : addtrees_from_xgb_json(f);
+    }
+
+} // namespace veritas
@@ -0,0 +1,46 @@
+/**
+ * \file xgb.hpp
+ *
+ * Import XGBoost models saved with `Booster.save_model` in the JSON or
+ * UBJSON format, without going through Python.
+ *
+ * Copyright 2022 DTAI Research Group - KU Leuven.
+ * License: Apache License 2.0
+ * Author: Laurens Devos
+*/
+
+#ifndef VERITAS_XGB_HPP
+#define VERITAS_XGB_HPP
+
+#include "tree.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace veritas {
+
+    /**
+     * Read an XGBoost JSON model. Returns one AddTree per output group:
+     * one for regression and binary classification, `num_class` for
+     * multiclass models (tree `i` belongs to group `tree_info[i]`).
+     *
+     * The `base_score` of each AddTree is the base margin: XGBoost's
+     * base_score transformed by the objective's link function (e.g., the
+     * logit for `binary:logistic`).
+     *
+     * XGBoost sends missing values to each node's default direction;
+     * veritas always sends NaN right. Only `gbtree` boosters with numerical
+     * splits are supported.
+     */
+    std::vector<AddTree> addtrees_from_xgb_json(std::istream& strm);
+
+    /** Like ::addtrees_from_xgb_json, but for the UBJSON format. */
+    std::vector<AddTree> addtrees_from_xgb_ubjson(std::istream& strm);
+
+    /** Read an XGBoost model file, UBJSON if the extension is `.ubj`,
+     * JSON otherwise. */
+    std::vector<AddTree> addtrees_from_xgb_file(const std::string& path);
+
+} // namespace veritas
+
+#endif // VERITAS_XGB_HPP
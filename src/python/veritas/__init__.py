@@ -11,14 +11,16 @@ del pyveritas
 try: # fails when xgboost not installed
     from .xgb import \
         addtree_from_xgb_model, \
-        addtrees_from_multiclass_xgb_model
+        addtrees_from_multiclass_xgb_model, \
+        addtrees_from_xgb_booster
     del xgb
 except ModuleNotFoundError as e: pass
 
 try: # fails when xgboost not installed
     from .lgb import \
         addtree_from_lgb_model, \
-        addtrees_from_multiclass_lgb_model
+        addtrees_from_multiclass_lgb_model, \
+        addtrees_from_lgb_booster
     del lgb
 except ModuleNotFoundError as e: pass
 
@@ -60,48 +62,59 @@ def __domain_hash(self):
 
 setattr(Domain, "hash", __domain_hash)
 
+# JSON is streamed in chunks through the C++ reader and writer, so large
+# (gzip) files are never held in memory as a whole.
 def __addtree_write(self, f, compress=False):
-    if compress:
-        with gzip.open(f, "wb") as fh:
-            json = self.to_json()
-            fh.write(json.encode("utf-8"))
-    else:
-        with open(f, "w") as fh:
-            fh.write(self.to_json())
+    opener = gzip.open if compress else open
+    with opener(f, "wb") as fh:
+        self.to_json_stream(fh.write)
 
 def __addtree_read(f, compressed=False):
-    if compressed:
-        with gzip.open(f, "rb") as fh:
-            json = fh.read()
-            return AddTree.from_json(json.decode("utf-8"))
-    else:
-        with open(f, "r") as fh:
-            return AddTree.from_json(fh.read())
+    opener = gzip.open if compressed else open
+    with opener(f, "rb") as fh:
+        return AddTree.from_json_stream(fh.read)
 
 def __addtree_iter(self):
     for i in range(len(self)):
         yield self[i]
 
+## Evaluate the ensemble on each row of `data` by walking the trees. For many
+# rows, use `AddTree.eval_batch`, or `AddTree.compile()` once and
+# `CompiledAddTree.eval` for repeated calls.
 __addtree_eval_cpp = AddTree.eval
 def __addtree_eval(self, data):
-    data = np.array(data, dtype=np.float32)
+    data = np.asarray(data, dtype=np.float32) # no copy if already float32
     return __addtree_eval_cpp(self, data)
 
+## Evaluate the ensemble on a large batch of rows using `num_threads` threads
+# (0 = all cores), without holding the GIL. Compile the AddTree once using
+# `AddTree.compile()` and use `CompiledAddTree.eval` when scoring many batches.
+def __addtree_eval_batch(self, data, num_threads=0):
+    return self.compile().eval(data, num_threads)
+
+__addtree_relayout_cpp = AddTree.relayout
+def __addtree_relayout(self, layout, calibration=None):
+    if calibration is not None:
+        calibration = np.asarray(calibration, dtype=np.float32)
+    return __addtree_relayout_cpp(self, layout, calibration)
+
 setattr(AddTree, "write", __addtree_write)
 setattr(AddTree, "read", __addtree_read)
 setattr(AddTree, "__iter__", __addtree_iter)
 setattr(AddTree, "eval", __addtree_eval)
+setattr(AddTree, "eval_batch", __addtree_eval_batch)
+setattr(AddTree, "relayout", __addtree_relayout)
 
 __tree_eval_cpp = Tree.eval
 def __tree_eval(self, data, nid=None):
-    data = np.array(data, dtype=np.float32)
+    data = np.asarray(data, dtype=np.float32)
     if nid is None:
         nid = self.root()
     return __tree_eval_cpp(self, data, nid)
 
 __tree_eval_node_cpp = Tree.eval_node
 def __tree_eval_node(self, data, nid=None):
-    data = np.array(data, dtype=np.float32)
+    data = np.asarray(data, dtype=np.float32)
     if nid is None:
         nid = self.root()
     return __tree_eval_node_cpp(self, data, nid)
@@ -109,6 +122,53 @@ def __tree_eval_node(self, data, nid=None):
 setattr(Tree, "eval", __tree_eval)
 setattr(Tree, "eval_node", __tree_eval_node)
 
+__tree_compute_visit_counts_cpp = Tree.compute_visit_counts
+def __tree_compute_visit_counts(self, data):
+    data = np.asarray(data, dtype=np.float32)
+    return __tree_compute_visit_counts_cpp(self, data)
+
+setattr(Tree, "compute_visit_counts", __tree_compute_visit_counts)
+
+__compiled_eval_cpp = CompiledAddTree.eval
+def __compiled_eval(self, data, num_threads=1):
+    data = np.asarray(data, dtype=np.float32) # C- or F-contiguous, no copy
+    return __compiled_eval_cpp(self, data, num_threads)
+
+__compiled_eval_node_cpp = CompiledAddTree.eval_node
+def __compiled_eval_node(self, data, tree_index):
+    data = np.asarray(data, dtype=np.float32)
+    return __compiled_eval_node_cpp(self, data, tree_index)
+
+setattr(CompiledAddTree, "eval", __compiled_eval)
+setattr(CompiledAddTree, "eval_node", __compiled_eval_node)
+
+__quickscorer_eval_cpp = QuickScorer.eval
+def __quickscorer_eval(self, data):
+    data = np.asarray(data, dtype=np.float32)
+    return __quickscorer_eval_cpp(self, data)
+
+setattr(QuickScorer, "eval", __quickscorer_eval)
+
+__native_eval_cpp = NativePredictor.eval
+def __native_eval(self, data):
+    data = np.asarray(data, dtype=np.float32)
+    return __native_eval_cpp(self, data)
+
+__native_is_bit_exact_cpp = NativePredictor.is_bit_exact
+def __native_is_bit_exact(self, at, data):
+    data = np.asarray(data, dtype=np.float32)
+    return __native_is_bit_exact_cpp(self, at, data)
+
+setattr(NativePredictor, "eval", __native_eval)
+setattr(NativePredictor, "is_bit_exact", __native_is_bit_exact)
+
+__batch_robustness_search_cpp = BatchRobustnessSearch.search
+def __batch_robustness_search(self, examples, max_time):
+    examples = np.asarray(examples, dtype=np.float32)
+    return __batch_robustness_search_cpp(self, examples, max_time)
+
+setattr(BatchRobustnessSearch, "search", __batch_robustness_search)
+
 from .util import *
 del util
 
@@ -119,3 +179,6 @@ except ModuleNotFoundError as e: pass
 
 from .robustness import *
 del robustness
+
+from .shared import *
+del shared
@@ -9,10 +9,26 @@
 from lightgbm import Booster
 import numpy as np
 
+from . import addtrees_from_lgb_string
 from .xgb import GbAddTree
 
+def addtrees_from_lgb_booster(model):
+    """
+    Convert a LightGBM model using the C++ importer for LightGBM's text
+    format. Returns one AddTree per output group (`num_class` for multiclass
+    models). Features are identified by their index.
+    """
+    if not isinstance(model, Booster) and hasattr(model, "booster_"):
+        model = model.booster_ # scikit-learn interface
+    assert isinstance(model, Booster), f"not lgb.Booster but {type(model)}"
+    return addtrees_from_lgb_string(model.model_to_string())
+
 def addtrees_from_multiclass_lgb_model(model, nclasses, feat2id_map=int):
-    pass
+    if feat2id_map is not int:
+        raise RuntimeError("custom feat2id_map not supported for multiclass models")
+    ats = addtrees_from_lgb_booster(model)
+    assert len(ats) == nclasses, f"model has {len(ats)} classes, not {nclasses}"
+    return ats
 
 def addtree_from_lgb_model(model, feat2id_map=int):
     """
@@ -7,7 +7,7 @@
 import timeit, time, os, contextlib
 import numpy as np
 
-from . import AddTree, Search, get_closest_example, Domain
+from . import AddTree, Search, PreparedEnsemble, get_closest_example, Domain
 
 try:
     from .kantchelian import KantchelianOutputOpt
@@ -164,8 +164,11 @@ class VeritasRobustnessSearch(RobustnessSearch):
         else:
             raise RuntimeError("source_at and target_at None")
 
+        # shared by the searches of all binary search steps
+        self.prepared = PreparedEnsemble(self.at)
+
     def get_search(self, delta):
-        s = Search.max_output(self.at)
+        s = Search.max_output(self.prepared)
         #s.set_example(self.example)
         s.stop_when_optimal = True
         s.stop_when_upper_less_than = 0.0
@@ -179,7 +182,7 @@ class VeritasRobustnessSearch(RobustnessSearch):
 
         s.set_mem_capacity(self.mem_capacity)
         box = [Domain(x-delta, x+delta) for x in self.example]
-        s.prune(box)
+        s.restrict(box) # cheap: keeps the prepared ensemble
         return s
 
     def get_max_output_difference(self, delta, max_time):
@@ -0,0 +1,59 @@
+## \file shared.py
+#
+# Share a single read-only copy of an AddTree between processes.
+#
+# Copyright 2022 DTAI Research Group - KU Leuven.
+# License: Apache License 2.0
+# Author: Laurens Devos
+
+import os, uuid
+
+from . import AddTree
+
+## \ingroup python
+# \brief An AddTree in a POSIX shared memory segment.
+#
+# The creating process places the model in a new segment and owns it. Pickling
+# only sends the segment name, so `multiprocessing` workers attach to the same
+# pages instead of each deserializing a private copy. `self.at` is a read-only
+# view; pass it to `Search` as usual. A tree is copied into process memory
+# when it is modified.
+#
+# ```
+# with SharedAddTree(at) as shared:
+#     with multiprocessing.Pool(64) as pool:
+#         pool.map(functools.partial(work, shared), examples)
+# ```
+class SharedAddTree:
+    def __init__(self, at, name=None):
+        if name is None:
+            name = f"/veritas-{os.getpid()}-{uuid.uuid4().hex[:12]}"
+        at.to_shared_memory(name)
+        self.name = name
+        self._owner = True
+        self.at = AddTree.attach_shared_memory(name)
+
+    def __getstate__(self):
+        return self.name
+
+    def __setstate__(self, name):
+        self.name = name
+        self._owner = False
+        self.at = AddTree.attach_shared_memory(name)
+
+    ## Remove the segment. Attached processes keep their mapping, but new
+    # processes can no longer attach.
+    def close(self):
+        if self._owner:
+            self._owner = False
+            AddTree.unlink_shared_memory(self.name)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        try: self.close()
+        except Exception: pass
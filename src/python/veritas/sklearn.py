@@ -16,23 +16,26 @@ class RfAddTree(AddTree):
 
 # https://scikit-learn.org/stable/auto_examples/tree/plot_unveil_tree_structure.html
 
+# The `tree_` arrays are passed to the C++ side without copying and the trees
+# are built in parallel. Leaf values are computed for all nodes at once by
+# `leaf_values_fun(tree_.value)`, where tree_.value has shape
+# (num_nodes, num_outputs, num_classes).
+
+def _tree_arrays(tree, leaf_values_fun):
+    return (tree.children_left, tree.children_right, tree.feature,
+            tree.threshold, leaf_values_fun(tree.value)) # <= splits
+
+def _per_node(extract_value_fun):
+    return lambda values: np.array([extract_value_fun(v) for v in values])
+
 def _addtree_from_sklearn_tree(at, tree, extract_value_fun):
-    t = at.add_tree()
-    stack = [(0, t.root())]
-    while len(stack) != 0:
-        n, m = stack.pop()
-        is_internal = tree.children_left[n] != tree.children_right[n]
+    at.add_tree_from_arrays(*_tree_arrays(tree, _per_node(extract_value_fun)))
 
-        if is_internal:
-            feat_id = tree.feature[n]
-            thrs = tree.threshold[n]
-            split_value = np.nextafter(np.float32(thrs), np.float32(np.inf)) # <= splits
-            t.split(m, feat_id, split_value)
-            stack.append((tree.children_right[n], t.right(m)))
-            stack.append((tree.children_left[n], t.left(m)))
-        else:
-            leaf_value = extract_value_fun(tree.value[n])
-            t.set_leaf_value(m, leaf_value)
+def _addtree_from_sklearn_ensemble(ensemble, leaf_values_fun):
+    at = RfAddTree()
+    at.add_trees_from_arrays([_tree_arrays(tree.tree_, leaf_values_fun)
+        for tree in ensemble.estimators_])
+    return at
 
 ## Extract a Veritas AddTree from a scikit learn ensemble model (e.g. random
 # forest)
@@ -42,20 +45,19 @@ def _addtree_from_sklearn_tree(at, tree, extract_value_fun):
 # As far as I can tell, this corresponds with sklearn's predict_proba
 def addtree_from_sklearn_ensemble(ensemble, extract_value_fun=None):
     num_trees = len(ensemble.estimators_)
-    if extract_value_fun is None:
-        if "Regressor" in type(ensemble).__name__:
-            print("SKLEARN: regressor")
-            extract_value_fun = lambda v: v[0]
-        elif "Classifier" in type(ensemble).__name__:
-            print("SKLEARN: binary classifier")
-            extract_value_fun = lambda v: (v[0][1]/sum(v[0])) # class ratio
-        else:
-            raise RuntimeError("cannot determine extract_value_fun for:",
-                    type(ensemble).__name__)
+    if extract_value_fun is not None:
+        leaf_values_fun = _per_node(extract_value_fun)
+    elif "Regressor" in type(ensemble).__name__:
+        print("SKLEARN: regressor")
+        leaf_values_fun = lambda v: v[:, 0, 0]
+    elif "Classifier" in type(ensemble).__name__:
+        print("SKLEARN: binary classifier")
+        leaf_values_fun = lambda v: v[:, 0, 1] / v[:, 0, :].sum(axis=1) # class ratio
+    else:
+        raise RuntimeError("cannot determine extract_value_fun for:",
+                type(ensemble).__name__)
 
-    at = RfAddTree()
-    for tree in ensemble.estimators_:
-        _addtree_from_sklearn_tree(at, tree.tree_, extract_value_fun)
+    at = _addtree_from_sklearn_ensemble(ensemble, leaf_values_fun)
     at.base_score = -num_trees / 2
     return at
     
@@ -66,10 +68,8 @@ def addtrees_from_multiclass_sklearn_ensemble(ensemble, num_classes):
     addtrees = []
     num_trees = len(ensemble.estimators_)
     for i in range(num_classes):
-        extract_value_fun = lambda v: (v[0][i]/sum(v[0]))/num_trees
-        at = addtree_from_sklearn_ensemble(ensemble, extract_value_fun)
+        leaf_values_fun = lambda v, i=i: (v[:, 0, i] / v[:, 0, :].sum(axis=1)) / num_trees
+        at = _addtree_from_sklearn_ensemble(ensemble, leaf_values_fun)
+        at.base_score = -num_trees / 2
         addtrees.append(at)
     return addtrees
-
-
-
@@ -101,6 +101,33 @@ def get_closest_example(solution_or_box, example, featmap=None):
 # \skipline py::class_<AddTree
 # \until ; // AddTree
 
+## \ingroup python
+# \class CompiledAddTree
+# \brief Bindings to C++ veritas::CompiledAddTree class.
+#
+# In `bindings.cpp`:
+# \dontinclude[lineno] bindings.cpp
+# \skipline py::class_<CompiledAddTree>
+# \until ; // CompiledAddTree
+
+## \ingroup python
+# \class QuickScorer
+# \brief Bindings to C++ veritas::QuickScorer class.
+#
+# In `bindings.cpp`:
+# \dontinclude[lineno] bindings.cpp
+# \skipline py::class_<QuickScorer>
+# \until ; // QuickScorer
+
+## \ingroup python
+# \class NativePredictor
+# \brief Bindings to C++ veritas::NativePredictor class.
+#
+# In `bindings.cpp`:
+# \dontinclude[lineno] bindings.cpp
+# \skipline py::class_<NativePredictor>
+# \until ; // NativePredictor
+
 ## \ingroup python
 # \class FeatMap
 # \brief Bindings to C++ veritas::FeatMap struct.
@@ -6,13 +6,13 @@
 # License: Apache License 2.0
 # Author: Laurens Devos
 
-import json
+import json, os, tempfile
 import numpy as np
 
 from xgboost.sklearn import XGBModel
 from xgboost.core import Booster
 
-from . import AddTree
+from . import AddTree, addtrees_from_xgb_file
 
 class GbAddTree(AddTree):
     def predict_proba(self, X):
@@ -24,6 +24,30 @@ def addtrees_from_multiclass_xgb_model(model, nclasses, feat2id_map=int):
         for clazz in range(nclasses)
     ]
 
+def addtrees_from_xgb_booster(model):
+    """
+    Convert an XGBoost model using the C++ importer. The model is saved to a
+    temporary JSON file, which is read without going through Python.
+
+    Returns one AddTree per output group (`num_class` for multiclass models).
+    The base_score of the AddTrees is XGBoost's base margin, i.e., the
+    base_score transformed by the objective's link function.
+
+    Features are identified by their index; use `addtree_from_xgb_model` for
+    custom feature name mappings.
+    """
+    if isinstance(model, XGBModel):
+        model = model.get_booster()
+    assert isinstance(model, Booster), f"not xgb.Booster but {type(model)}"
+
+    fd, path = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+    try:
+        model.save_model(path)
+        return addtrees_from_xgb_file(path)
+    finally:
+        os.remove(path)
+
 def addtree_from_xgb_model(model, feat2id_map=int,
         multiclass=(0, 1)):
     """
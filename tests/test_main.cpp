@@ -1,11 +1,23 @@
 #include "features.hpp"
 #include "search.hpp"
+#include "partitioned_search.hpp"
+#include "portfolio_search.hpp"
+#include "robustness.hpp"
 #include "constraints.hpp"
+#include "compiled.hpp"
+#include "quickscorer.hpp"
+#include "native.hpp"
+#include "json.hpp"
+#include "xgb.hpp"
+#include "lgb.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <assert.h>
 #include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
 
 using namespace veritas;
 
@@ -393,6 +405,95 @@ void test_json2() {
   assert(at == at2);
 }
 
+void test_json3()
+{
+    // values that do not survive printing with 6 significant digits
+    AddTree at;
+    at.base_score = 0.1f;
+    {
+        Tree& tree = at.add_tree();
+        tree.root().split({3, std::nextafter(12.3f, 13.0f)});
+        tree.root().left().set_leaf_value(1e-30f);
+        tree.root().right().set_leaf_value(-123456.789f);
+    }
+    {
+        // deep chain: parsing and writing must not recurse
+        Tree& tree = at.add_tree();
+        auto n = tree.root();
+        for (int i = 0; i < 20000; ++i)
+        {
+            n.split({i % 3, static_cast<FloatT>(i) / 7.0f});
+            n.left().set_leaf_value(static_cast<FloatT>(i) / 3.0f);
+            n = n.right();
+        }
+        n.set_leaf_value(std::numeric_limits<FloatT>::infinity());
+    }
+
+    std::string json;
+    {
+        JsonWriter w([&json](const char *data, size_t n) { json.append(data, n); }, 64);
+        at.to_json(w);
+        w.flush();
+    }
+
+    // tiny buffer to exercise refills inside tokens
+    size_t pos = 0;
+    JsonReader r([&](char *buf, size_t cap) {
+        size_t n = std::min(cap, json.size() - pos);
+        std::copy(json.begin() + pos, json.begin() + pos + n, buf);
+        pos += n;
+        return n;
+    }, 16);
+    AddTree at2;
+    at2.from_json(r);
+
+    assert(at2.base_score == at.base_score);
+    assert(at2.num_nodes() == at.num_nodes());
+    for (size_t t = 0; t < at.size(); ++t)
+        for (size_t i = 0; i < at[t].num_nodes(); ++i)
+        {
+            auto n1 = at[t][static_cast<NodeId>(i)];
+            auto n2 = at2[t][static_cast<NodeId>(i)];
+            if (n1.is_leaf())
+                assert(n2.is_leaf() && n1.leaf_value() == n2.leaf_value());
+            else
+                assert(n1.get_split() == n2.get_split());
+        }
+
+    std::stringstream s;
+    at2.to_json(s);
+    assert(s.str() == json);
+
+    // invalid input
+    std::stringstream bad("{\"base_score\": 0.5, \"trees\": [{\"lt\": {\"leaf_value\": 1}}]}");
+    bool thrown = false;
+    try { AddTree at3; at3.from_json(bad); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+
+    // UTF-8 strings (bytes >= 0x80, including 0xFF) are not end of input
+    std::string name = "temp\xc2\xb0" "C \xe6\xb8\xa9\xe5\xba\xa6 \xff";
+    std::string doc;
+    {
+        JsonWriter w([&doc](const char *data, size_t n) { doc.append(data, n); }, 8);
+        w.raw("{\"feature_names\": [\"").raw(name.c_str()).raw("\"], \"base_score\": ")
+            .number(0.5f).raw('}');
+        w.flush();
+    }
+    std::stringstream utf8(doc);
+    JsonReader r2(utf8, 4);
+    r2.expect(JsonReader::Token::BEGIN_OBJECT);
+    r2.expect(JsonReader::Token::STRING);
+    r2.expect(JsonReader::Token::BEGIN_ARRAY);
+    r2.expect(JsonReader::Token::STRING);
+    assert(r2.text() == name);
+    r2.expect(JsonReader::Token::END_ARRAY);
+    r2.expect(JsonReader::Token::STRING);
+    r2.expect(JsonReader::Token::VALUE);
+    assert(r2.float_value() == 0.5f);
+    r2.expect(JsonReader::Token::END_OBJECT);
+    assert(r2.next() == JsonReader::Token::END);
+}
+
 void test_eval1()
 {
     AddTree at;
@@ -469,6 +570,309 @@ void test_eval2()
     }
 }
 
+void test_compiled1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-easy.json");
+        at.from_json(f);
+    }
+
+    CompiledAddTree cat(at);
+    assert(cat.size() == at.size());
+    assert(cat.num_nodes() == at.num_nodes());
+
+    // column-major, number of rows not a multiple of the block size
+    size_t num_rows = 3*CompiledAddTree::ROW_BLOCK_SIZE + 7;
+    std::vector<FloatT> buf(num_rows * 2);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = static_cast<FloatT>((i * 7919) % 100);
+    data d {&buf[0], num_rows, 2, 1, num_rows};
+
+    std::vector<FloatT> out(num_rows);
+    cat.eval(d, &out[0]);
+
+    for (size_t i = 0; i < num_rows; ++i)
+    {
+        assert(out[i] == at.eval(d.row(i))); // bit-exact
+        assert(cat.eval(d.row(i)) == at.eval(d.row(i)));
+        for (size_t t = 0; t < at.size(); ++t)
+            assert(cat.eval_node(t, d.row(i)) == at[t].eval_node(d.row(i)));
+    }
+
+    ThreadPool pool(3);
+    std::vector<FloatT> out_par(num_rows);
+    cat.eval(d, &out_par[0], pool);
+    assert(out == out_par);
+}
+
+void test_compiled_simd1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+    CompiledAddTree cat(at);
+
+    // row-major with a padding column, some NaNs, tail rows for each kernel
+    size_t num_rows = 5*CompiledAddTree::ROW_BLOCK_SIZE + 13;
+    std::vector<FloatT> buf(num_rows * 3);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = (i % 37 == 0)
+            ? std::numeric_limits<FloatT>::quiet_NaN()
+            : static_cast<FloatT>((i * 7919) % 101);
+    data d {&buf[0], num_rows, 2, 3, 1};
+
+    for (SimdIsa isa : {SimdIsa::SCALAR, SimdIsa::AVX2, SimdIsa::AVX512})
+    {
+        if (!cpu_supports(isa))
+            continue;
+        cat.set_simd_isa(isa);
+        std::vector<FloatT> out(num_rows);
+        cat.eval(d, &out[0]);
+        for (size_t i = 0; i < num_rows; ++i)
+            assert(out[i] == at.eval(d.row(i))); // bit-exact
+    }
+}
+
+void test_quickscorer1()
+{
+    for (const char *fname : {"tests/models/xgb-img-easy.json",
+                              "tests/models/xgb-img-hard.json"})
+    {
+        AddTree at;
+        {
+            std::ifstream f;
+            f.open(fname);
+            at.from_json(f);
+        }
+        QuickScorer qs(at);
+        assert(qs.size() == at.size());
+        assert(qs.num_splits() == at.num_nodes() - at.num_leafs());
+
+        size_t num_rows = 301;
+        std::vector<FloatT> buf(num_rows * 2);
+        for (size_t i = 0; i < buf.size(); ++i)
+            buf[i] = (i % 37 == 0)
+                ? std::numeric_limits<FloatT>::quiet_NaN()
+                : static_cast<FloatT>((i * 7919) % 101);
+        data d {&buf[0], num_rows, 2, 2, 1};
+
+        std::vector<FloatT> out(num_rows);
+        qs.eval(d, &out[0]);
+        for (size_t i = 0; i < num_rows; ++i)
+        {
+            assert(out[i] == at.eval(d.row(i))); // bit-exact
+            assert(qs.eval(d.row(i)) == out[i]);
+        }
+    }
+}
+
+void bench_eval1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+
+    size_t num_rows = 100000;
+    std::vector<FloatT> buf(num_rows * 2);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = static_cast<FloatT>((i * 7919) % 101);
+    data d {&buf[0], num_rows, 2, 2, 1};
+    std::vector<FloatT> out(num_rows);
+
+    auto time = [&](const char *name, auto&& f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << dt.count() << "s" << std::endl;
+    };
+
+    time("AddTree::eval", [&]() {
+        for (size_t i = 0; i < num_rows; ++i)
+            out[i] = at.eval(d.row(i));
+    });
+    CompiledAddTree cat(at);
+    time("CompiledAddTree::eval", [&]() { cat.eval(d, &out[0]); });
+    for (SimdIsa isa : {SimdIsa::SCALAR, SimdIsa::AVX2, SimdIsa::AVX512})
+    {
+        if (!cpu_supports(isa))
+            continue;
+        cat.set_simd_isa(isa);
+        std::cout << isa << ' ';
+        time("CompiledAddTree::eval", [&]() { cat.eval(d, &out[0]); });
+    }
+    QuickScorer qs(at);
+    time("QuickScorer::eval", [&]() { qs.eval(d, &out[0]); });
+    std::string so_path = (std::filesystem::temp_directory_path()
+            / "veritas_bench_eval1.so").string();
+    NativePredictor np = NativePredictor::build(at, so_path);
+    time("NativePredictor::eval", [&]() { np.eval(d, &out[0]); });
+    std::filesystem::remove(so_path);
+    std::filesystem::remove(so_path + ".cpp");
+}
+
+void test_relayout1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+
+    size_t num_rows = 200;
+    std::vector<FloatT> buf(num_rows * 2);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = static_cast<FloatT>((i * 7919) % 101);
+    data d {&buf[0], num_rows, 2, 2, 1};
+
+    for (NodeLayout layout : {NodeLayout::BFS, NodeLayout::DFS_HOT, NodeLayout::VEB})
+    {
+        for (bool calibrate : {false, true})
+        {
+            AddTree at2(at);
+            auto maps = calibrate ? at2.relayout(layout, d) : at2.relayout(layout);
+            assert(at2 == at); // same structure
+            assert(maps.size() == at.size());
+
+            for (size_t t = 0; t < at.size(); ++t)
+            {
+                const Tree& tree = at2[t];
+                for (size_t i = 1; i < tree.num_nodes(); ++i)
+                {
+                    NodeId id = static_cast<NodeId>(i);
+                    assert(tree[id].parent().id() < id);
+                    assert(tree[id].parent().left().id() == id - !tree[id].is_left_child());
+                }
+                for (size_t i = 0; i < num_rows; ++i)
+                    assert(maps[t][at[t].eval_node(d.row(i))] == tree.eval_node(d.row(i)));
+            }
+
+            if (layout == NodeLayout::BFS)
+                for (const Tree& tree : at2)
+                    for (size_t i = 1; i < tree.num_nodes(); ++i)
+                        assert(tree[static_cast<NodeId>(i-1)].depth()
+                                <= tree[static_cast<NodeId>(i)].depth());
+        }
+    }
+}
+
+void test_native1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-easy.json");
+        at.from_json(f);
+    }
+    at.base_score = 0.1f;
+
+    std::string so_path = (std::filesystem::temp_directory_path()
+            / "veritas_test_native1.so").string();
+    NativePredictor np = NativePredictor::build(at, so_path);
+    assert(np.size() == at.size());
+
+    size_t num_rows = 301;
+    std::vector<FloatT> buf(num_rows * 2);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = (i % 37 == 0)
+            ? std::numeric_limits<FloatT>::quiet_NaN()
+            : static_cast<FloatT>((i * 7919) % 101);
+    data d {&buf[0], num_rows, 2, 2, 1};
+
+    assert(np.is_bit_exact(at, d));
+
+    std::vector<FloatT> out(num_rows);
+    np.eval(d, &out[0]);
+    for (size_t i = 0; i < num_rows; ++i)
+        assert(out[i] == at.eval(d.row(i)));
+
+    // reload from disk
+    NativePredictor np2(so_path);
+    assert(np2.eval(d.row(3)) == out[3]);
+
+    // the moved-from object no longer evaluates
+    NativePredictor np3(std::move(np2));
+    assert(np3.eval(d.row(3)) == out[3]);
+    assert(np2.size() == 0);
+    bool thrown = false;
+    try { np2.eval(d.row(3)); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+
+    // move assignment releases the old library and clears the source
+    NativePredictor np4(so_path);
+    np4 = std::move(np3);
+    assert(np4.eval(d.row(3)) == out[3]);
+    assert(np3.size() == 0);
+    thrown = false;
+    try { np3.eval(d.row(3)); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+
+    std::filesystem::remove(so_path);
+    std::filesystem::remove(so_path + ".cpp");
+}
+
+void test_binary1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+    at.base_score = 0.25f;
+    at[1].relayout(NodeLayout::VEB);
+
+    std::string path = (std::filesystem::temp_directory_path()
+            / "veritas_test_binary1.bin").string();
+    at.to_binary(path);
+
+    AddTree at2;
+    {
+        std::ifstream f(path, std::ios::binary);
+        at2.from_binary(f);
+    }
+    assert(at2 == at);
+    assert(!at2[0].is_view());
+
+    AddTree at3;
+    at3.map_binary(path);
+    assert(at3 == at);
+    assert(at3.size() == at.size());
+    assert(at3[0].is_view());
+    assert(at3[1].num_nodes() == at[1].num_nodes());
+    assert(at3[1][5].parent().id() == at[1][5].parent().id());
+
+    std::vector<FloatT> buf = {12, 35, 70, 3, 101, 55};
+    data d {&buf[0], 3, 2, 2, 1};
+    for (size_t i = 0; i < d.num_rows; ++i)
+        assert(at3.eval(d.row(i)) == at.eval(d.row(i)));
+
+    // copies share the mapping, mutation copies the tree
+    AddTree at4(at3);
+    NodeId leaf = at4[0].get_leaf_ids()[0];
+    at4[0][leaf].set_leaf_value(1000.0);
+    assert(!at4[0].is_view() && at4[1].is_view());
+    assert(at3[0][leaf].leaf_value() == at[0][leaf].leaf_value());
+    NodeId leaf1 = at4[1].get_leaf_ids()[0];
+    at4[1][leaf1].split({0, 1.0});
+    assert(at4[1].num_nodes() == at[1].num_nodes() + 2);
+
+    std::stringstream s("not a binary model, but long enough for a header.........");
+    bool thrown = false;
+    try { AddTree at5; at5.from_binary(s); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+
+    std::filesystem::remove(path);
+}
+
 void test_prune1()
 {
     AddTree at;
@@ -1013,13 +1417,676 @@ void test_search1()
     //std::cout << t << std::endl;
 }
 
+void test_xgb1()
+{
+    auto close = [](FloatT a, FloatT b) { return std::abs(a - b) < 1e-5; };
+
+    // multi:softprob, 3 classes, 2 boosting rounds
+    std::vector<AddTree> ats = addtrees_from_xgb_file("tests/models/xgb-multiclass.json");
+    assert(ats.size() == 3);
+    for (const AddTree& at : ats)
+    {
+        assert(at.size() == 2);
+        assert(at.base_score == 0.5);
+    }
+
+    std::vector<FloatT> x0 = {1.0, 2.0, 3.0}, x1 = {9.0, 0.5, 5.5};
+    data d0 {x0.data(), 1, 3, 3, 1}, d1 {x1.data(), 1, 3, 3, 1};
+    // reference values from traversing the XGBoost arrays directly
+    assert(close(ats[0].eval(d0), 0.5f + -0.66531801f));
+    assert(close(ats[1].eval(d0), 0.5f + 0.21920711f));
+    assert(close(ats[2].eval(d0), 0.5f + -1.22826242f));
+    assert(close(ats[0].eval(d1), 0.5f + 0.00265735f));
+    assert(close(ats[2].eval(d1), 0.5f + 0.30409789f));
+
+    // binary:logistic with base_score 0.2: the margin is logit(0.2)
+    std::vector<AddTree> bin_json = addtrees_from_xgb_file("tests/models/xgb-binary.json");
+    std::vector<AddTree> bin_ubj = addtrees_from_xgb_file("tests/models/xgb-binary.ubj");
+    assert(bin_json.size() == 1 && bin_ubj.size() == 1);
+    assert(close(bin_json[0].base_score, std::log(0.25f)));
+    assert(bin_json[0] == bin_ubj[0]);
+    assert(bin_json[0].base_score == bin_ubj[0].base_score);
+    assert(close(bin_json[0].eval(d0), std::log(0.25f) + -3.03141880f));
+    assert(close(bin_json[0].eval(d1), std::log(0.25f) + -1.72529447f));
+
+    // UTF-8 feature names and attributes
+    std::vector<AddTree> bin_utf8 = addtrees_from_xgb_file("tests/models/xgb-binary-utf8.json");
+    assert(bin_utf8.size() == 1 && bin_utf8[0] == bin_json[0]);
+    assert(bin_utf8[0].base_score == bin_json[0].base_score);
+
+    std::stringstream s("{\"learner\": {\"gradient_booster\": {\"name\": \"dart\"}}}");
+    bool thrown = false;
+    try { addtrees_from_xgb_json(s); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+}
+
+void test_lgb1()
+{
+    constexpr FloatT inf = std::numeric_limits<FloatT>::infinity();
+    std::vector<AddTree> ats = addtrees_from_lgb_file("tests/models/lgb-multiclass.txt");
+    assert(ats.size() == 3);
+    for (const AddTree& at : ats)
+    {
+        assert(at.size() == 2);
+        assert(at.base_score == 0.0);
+    }
+
+    // LightGBM: left iff x <= threshold (double)
+    const Tree& t0 = ats[0][0];
+    assert(t0.root().get_split() == LtSplit(0, std::nextafter(2.5f, inf)));
+    // 0.3f > 0.30000000000000004 > 0.29999998f
+    assert(t0.root().right().get_split() == LtSplit(1, 0.3f));
+    const Tree& t1 = ats[1][0];
+    assert(t1.root().get_split() == LtSplit(2, std::nextafter(5.0f, inf)));
+    assert(t1.root().left().get_split() == LtSplit(2, std::nextafter(1e-35f, inf)));
+    assert(t1.root().left().right().leaf_value() == 0.25);
+    assert(t1.root().right().leaf_value() == -0.75);
+    assert(ats[2][0].root().is_leaf() && ats[2][0].root().leaf_value() == 0.0625);
+    assert(ats[0][1].root().get_split().split_value == inf);
+    assert(ats[1][1].root().get_split().split_value == -std::numeric_limits<FloatT>::max());
+
+    std::vector<FloatT> x = {2.5, 0.3f, 5.0};
+    data d {x.data(), 1, 3, 3, 1};
+    assert(ats[0].eval(d) == -1.25f + 0.1f);
+    x[0] = 3.0;
+    assert(ats[0].eval(d) == 2.0f + 0.1f);
+    x[1] = std::nextafter(0.3f, 0.0f);
+    assert(ats[0].eval(d) == 0.5f + 0.1f);
+    assert(ats[1].eval(d) == 0.25f + -0.2f);
+    x[2] = std::nextafter(5.0f, inf);
+    assert(ats[1].eval(d) == -0.75f + -0.2f);
+
+    std::stringstream s("tree\nTree=0\nnum_leaves=2\nsplit_feature=0\n");
+    bool thrown = false;
+    try { addtrees_from_lgb_text(s); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+}
+
+void test_from_arrays1()
+{
+    constexpr FloatT inf = std::numeric_limits<FloatT>::infinity();
+    // scikit-learn layout: depth-first, siblings not adjacent, -2 for leaves
+    std::vector<int64_t> left = {1, 2, -1, -1, -1};
+    std::vector<int64_t> right = {4, 3, -1, -1, -1};
+    std::vector<int64_t> feature = {0, 1, -2, -2, -2};
+    std::vector<double> threshold = {2.5, 0.30000000000000004, -2, -2, -2};
+    std::vector<double> value = {0, 0, 1.0, 2.0, 3.0};
+    TreeArrays arrays {5, left.data(), right.data(), feature.data(),
+        threshold.data(), value.data()};
+
+    Tree t = Tree::from_arrays(arrays);
+    assert(t.num_nodes() == 5);
+    assert(t.root().get_split() == LtSplit(0, std::nextafter(2.5f, inf)));
+    assert(t.root().left().get_split() == LtSplit(1, 0.3f));
+    assert(t.root().left().left().leaf_value() == 1.0);
+    assert(t.root().left().right().leaf_value() == 2.0);
+    assert(t.root().right().leaf_value() == 3.0);
+    assert(t.root().right().parent().id() == 0);
+    // node storage is in depth-first order, siblings adjacent
+    assert(t.node_data()[0].feat_id == 0 && t.node_data()[0].left == 1);
+    assert(t.node_data()[1].left == 3 && t.node_data()[2].value == 3.0);
+    assert(t.parent_data()[3] == 1 && t.parent_data()[4] == 1);
+
+    arrays.threshold_le = false;
+    assert(Tree::from_arrays(arrays).root().get_split() == LtSplit(0, 2.5));
+    arrays.threshold_le = true;
+
+    assert(le_split_value(1e300) == inf);
+    assert(le_split_value(-1e300) == -std::numeric_limits<FloatT>::max());
+    assert(le_split_value(1.0) == std::nextafter(1.0f, inf));
+
+    AddTree at;
+    ThreadPool pool(4);
+    at.add_tree_from_arrays(arrays);
+    at.add_trees_from_arrays(std::vector<TreeArrays>(100, arrays), pool);
+    assert(at.size() == 101);
+    for (const Tree& tree : at)
+        assert(tree == t);
+
+    // cycle
+    right[1] = 0;
+    bool thrown = false;
+    try { at.add_trees_from_arrays({arrays}, pool); }
+    catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown && at.size() == 101);
+}
+
+void test_shm1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-easy.json");
+        at.from_json(f);
+    }
+    // one tree without negative leaf values, which searches can share
+    {
+        Tree& t = at.add_tree();
+        t.root().split({0, 50.0});
+        t.root().left().set_leaf_value(1.0);
+        t.root().right().set_leaf_value(2.0);
+    }
+
+    std::string name = "/veritas_test_shm1";
+    try { AddTree::unlink_shared_memory(name); } catch (const std::runtime_error&) {}
+    at.to_shared_memory(name);
+
+    bool thrown = false;
+    try { at.to_shared_memory(name); } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown); // already exists
+
+    AddTree at2;
+    at2.attach_shared_memory(name);
+    AddTree::unlink_shared_memory(name); // at2 keeps its mapping
+    assert(at2 == at);
+    assert(at2.base_score == at.base_score);
+    assert(at2[0].is_view());
+
+    // trees that need no offset are shared, not copied
+    AddTree at3 = at2.neutralize_negative_leaf_values();
+    assert(at3[at3.size()-1].is_view());
+    assert(at3[at3.size()-1].node_data() == at2[at2.size()-1].node_data());
+
+    std::vector<FloatT> x = {10.0, 80.0};
+    data d {x.data(), 1, 2, 2, 1};
+    assert(at3.eval(d) == at.neutralize_negative_leaf_values().eval(d));
+
+    thrown = false;
+    try { AddTree at4; at4.attach_shared_memory(name); }
+    catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown); // unlinked
+}
+
+void test_cow1()
+{
+    Tree t;
+    t.root().split({0, 1.0});
+    t.root().left().set_leaf_value(-1.5);
+    t.root().right().split({1, 2.0});
+    t.root().right().left().set_leaf_value(2.0);
+    t.root().right().right().set_leaf_value(-0.0);
+
+    // copies share storage until modified
+    Tree u = t;
+    assert(u.is_shared() && t.is_shared());
+    assert(u.node_data() == t.node_data());
+    u.root().left().set_leaf_value(5.0);
+    assert(u.node_data() != t.node_data());
+    assert(!u.is_shared() && !t.is_shared());
+    assert(t.root().left().leaf_value() == -1.5);
+
+    // data_owner pins the node storage: a mutation copies it first
+    {
+        Tree v = std::move(u);
+        std::shared_ptr<const void> owner = v.data_owner();
+        const inner::Node *nodes = v.node_data();
+        assert(v.is_shared());
+        v.root().left().split({2, 3.0});
+        assert(v.node_data() != nodes && nodes[1].is_leaf());
+        assert(nodes[1].value == 5.0);
+    }
+
+    // negation and offsets are leaf transforms on shared storage
+    Tree n = t.negate_leaf_values();
+    assert(n.has_leaf_transform() && n.node_data() == t.node_data());
+    assert(n.root().left().leaf_value() == 1.5);
+    assert(n.negate_leaf_values() == t);
+
+    Tree o = t.offset_leaf_values(0.25).negate_leaf_values();
+    assert(o.node_data() == t.node_data());
+    assert(o.root().left().leaf_value() == -(-1.5f + 0.25f));
+    Tree o2 = o.offset_leaf_values(0.1f); // second offset: materialized
+    assert(o2.node_data() != t.node_data());
+    assert(o2.root().left().leaf_value() == -(-1.5f + 0.25f) + 0.1f);
+    assert(o2.root().right().right().leaf_value() == -(-0.0f + 0.25f) + 0.1f);
+
+    // modifying a transformed tree applies the transform first
+    n.root().right().left().set_leaf_value(7.0);
+    assert(!n.has_leaf_transform());
+    assert(n.root().left().leaf_value() == 1.5 && n.root().right().left().leaf_value() == 7.0);
+    assert(t.root().left().leaf_value() == -1.5);
+
+    // same result as rebuilding the trees
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+    AddTree nat = at.concat_negated(at).neutralize_negative_leaf_values();
+    assert(nat.size() == 2 * at.size());
+    for (size_t i = 0; i < nat.size(); ++i)
+        assert(nat[i].node_data() == at[i % at.size()].node_data());
+
+    std::stringstream s;
+    nat.to_binary(s);
+    AddTree nat2;
+    nat2.from_binary(s);
+    assert(nat2 == nat && !nat2[at.size()].has_leaf_transform());
+
+    // leaf by leaf like the old rebuilding implementation: -v - offset
+    FloatT base_score = at.base_score - at.base_score;
+    for (size_t k = 0; k < nat.size(); ++k)
+    {
+        const Tree& orig = at[k % at.size()];
+        bool neg = k >= at.size();
+        auto [lo, hi] = orig.find_minmax_leaf_value();
+        FloatT offset = std::min<FloatT>(0.0, neg ? -hi : lo);
+        base_score += offset;
+        for (NodeId id : orig.get_leaf_ids())
+        {
+            FloatT v = orig[id].leaf_value();
+            assert(nat2[k][id].leaf_value() == (neg ? -v : v) - offset);
+        }
+    }
+    assert(nat.base_score == base_score);
+
+    // unchanged results of prune/limit_depth share storage
+    Box box;
+    BoxRef b(box);
+    assert(at.prune(b)[0].node_data() == at[0].node_data());
+    assert(at.limit_depth(1000)[0].node_data() == at[0].node_data());
+    assert(at.limit_depth(1)[0].node_data() != at[0].node_data());
+}
+
+void test_minmax1()
+{
+    AddTree at;
+    {
+        std::ifstream f;
+        f.open("tests/models/xgb-img-hard.json");
+        at.from_json(f);
+    }
+    for (size_t i = 0; i < at.size(); ++i)
+    {
+        const Tree& t = at[i];
+        for (Tree u : {t, t.negate_leaf_values(), t.offset_leaf_values(0.5f),
+                t.offset_leaf_values(-0.25f).negate_leaf_values()})
+        {
+            std::vector<std::tuple<FloatT, FloatT>> expected;
+            for (NodeId id = 0; id < static_cast<NodeId>(u.num_nodes()); ++id)
+                expected.push_back(u[id].find_minmax_leaf_value());
+            u.cache_minmax();
+            assert(u.has_minmax_cache());
+            for (NodeId id = 0; id < static_cast<NodeId>(u.num_nodes()); ++id)
+                assert(u[id].find_minmax_leaf_value() == expected[id]);
+        }
+    }
+
+    // copies share the cache, modifications drop it
+    Tree t = at[0];
+    t.cache_minmax();
+    Tree u = t;
+    assert(u.has_minmax_cache());
+    NodeId leaf = u.get_leaf_ids()[0];
+    u[leaf].set_leaf_value(1000.0);
+    assert(!u.has_minmax_cache() && t.has_minmax_cache());
+    assert(std::get<1>(u.find_minmax_leaf_value()) == 1000.0);
+    assert(std::get<1>(t.find_minmax_leaf_value()) < 1000.0);
+
+    // pruned iteration finds the same maximum
+    LeafIter it;
+    it.setup(t, BoxRef::null_box());
+    FloatT max = -FLOATT_INF;
+    NodeId id;
+    size_t pruned_count = 0;
+    while ((id = it.next(max)) != -1)
+    {
+        max = std::max(max, t[id].leaf_value());
+        ++pruned_count;
+    }
+    assert(max == std::get<1>(t.find_minmax_leaf_value()));
+    assert(pruned_count == 1); // best child first: straight to the max leaf
+
+    // and the same minimum, restricted to a box
+    Box box{{0, Domain::from_lo(10.0)}};
+    FloatT min = FLOATT_INF, min_expected = FLOATT_INF;
+    it.setup(t, BoxRef(box));
+    while ((id = it.next()) != -1)
+        min_expected = std::min(min_expected, t[id].leaf_value());
+    it.setup(t, BoxRef(box));
+    while ((id = it.next_min(min)) != -1)
+        min = std::min(min, t[id].leaf_value());
+    assert(min == min_expected);
+}
+
+/** Wide ensemble: each tree splits on a few of `8*max_depth` features. */
+AddTree wide_ensemble(int num_trees, int max_depth, unsigned seed)
+{
+    AddTree at;
+    std::mt19937 rng(seed);
+    for (int i = 0; i < num_trees; ++i)
+    {
+        Tree& t = at.add_tree();
+        std::vector<NodeId> level {t.root().id()};
+        for (int depth = 0; depth < max_depth; ++depth)
+        {
+            // one feature per level: paths never split on a feature twice
+            FeatId feat_id = static_cast<FeatId>(rng() % 8) * max_depth + depth;
+            std::vector<NodeId> next;
+            for (NodeId id : level)
+            {
+                t[id].split({feat_id, static_cast<FloatT>(rng() % 10)});
+                next.push_back(t[id].left().id());
+                next.push_back(t[id].right().id());
+            }
+            level = next;
+        }
+        for (NodeId id : level)
+            t[id].set_leaf_value(static_cast<FloatT>(rng() % 100) / 100.0f - 0.5f);
+    }
+    return at;
+}
+
+void test_incremental1()
+{
+    AddTree at = wide_ensemble(60, 3, 3);
+
+    // reusing per-tree terms (from the parent or the tree caches) gives the
+    // exact same search
+    Search<MaxOutputHeuristic> s0(at), s1(at);
+    s0.incremental_heuristic = false;
+    s0.tree_cache_slots = 0;
+    s0.use_leaf_tables = false;
+    s0.eps = s1.eps = 0.9;
+    s0.auto_eps = s1.auto_eps = false;
+    s0.steps(2000);
+    s1.steps(2000);
+    assert(s0.num_solutions() == s1.num_solutions());
+    assert(s0.num_open() == s1.num_open());
+    assert(s0.current_bounds() == s1.current_bounds());
+    for (size_t i = 0; i < s0.num_solutions(); ++i)
+        assert(s0.get_solution(i).output == s1.get_solution(i).output);
+    assert(s0.snapshots.back().num_cache_hits == 0);
+    assert(s1.snapshots.back().num_cache_hits > 0);
+
+    std::vector<FloatT> example(24, 5.0);
+    Search<MinDistToExampleHeuristic> d0(at, example, 0.0), d1(at, example, 0.0);
+    d0.incremental_heuristic = false;
+    d0.tree_cache_slots = 0;
+    d0.use_leaf_tables = false;
+    d0.steps(1000);
+    d1.steps(1000);
+    assert(d0.num_solutions() == d1.num_solutions());
+    assert(d0.current_bounds() == d1.current_bounds());
+    assert(d1.snapshots.back().num_cache_hits > 0);
+
+    // a capacity below the stores' initial blocks still runs out of memory
+    Search<MaxOutputHeuristic> s2(at);
+    s2.stop_when_optimal = false;
+    s2.set_mem_capacity(size_t(8)*1024*1024);
+    assert(s2.remaining_mem_capacity() < size_t(8)*1024*1024);
+    bool out_of_memory = false;
+    try {
+        for (int i = 0; i < 1000 && s2.steps(1000) == StopReason::NONE; ++i) {}
+    } catch (const std::runtime_error&) { out_of_memory = true; }
+    assert(out_of_memory);
+}
+
+void test_hda1()
+{
+    AddTree at = wide_ensemble(30, 3, 11);
+
+    // the partitioned open list finds the same optimum
+    Search<MaxOutputHeuristic> s0(at), s1(at);
+    s1.num_threads = 4;
+    StopReason r0 = StopReason::NONE, r1 = StopReason::NONE;
+    while (r0 == StopReason::NONE) r0 = s0.steps(1000);
+    while (r1 == StopReason::NONE) r1 = s1.steps(1000);
+    assert(r0 == StopReason::OPTIMAL && r1 == StopReason::OPTIMAL);
+    assert(s1.is_optimal());
+    assert(s0.get_solution(0).output == s1.get_solution(0).output);
+    assert(s1.get_at_output_for_box(s1.get_solution(0).box)
+            == s1.get_solution(0).output);
+    for (size_t i = 1; i < s1.num_solutions(); ++i)
+        assert(s1.get_solution(i-1).output >= s1.get_solution(i).output);
+
+    AddTree at2 = wide_ensemble(4, 3, 11);
+    std::vector<FloatT> example(24, 5.0);
+    Search<MinDistToExampleHeuristic> d0(at2, example, 0.0), d1(at2, example, 0.0);
+    d1.num_threads = 4;
+    r0 = r1 = StopReason::NONE;
+    while (r0 == StopReason::NONE) r0 = d0.steps(1000);
+    while (r1 == StopReason::NONE) r1 = d1.steps(1000);
+    assert(d0.num_solutions() > 0 && d1.num_solutions() > 0);
+    assert(std::get<0>(d0.current_bounds()) == std::get<0>(d1.current_bounds()));
+}
+
+void test_partitioned1()
+{
+    AddTree at = wide_ensemble(30, 3, 11);
+
+    std::vector<Box> boxes = partition_input_space(at, 4);
+    assert(boxes.size() == 4);
+    for (size_t i = 0; i < boxes.size(); ++i)
+        for (size_t j = i+1; j < boxes.size(); ++j)
+            assert(!BoxRef(boxes[i]).overlaps(BoxRef(boxes[j])));
+
+    Search<MaxOutputHeuristic> s0(at);
+    PartitionedSearch<MaxOutputHeuristic> s1(at, 4, 2);
+    assert(s1.num_parts() == 4);
+    for (size_t i = 1; i < s1.num_parts(); ++i)
+        assert(s1.part(i).prepared() == s1.part(0).prepared());
+    StopReason r0 = StopReason::NONE, r1 = StopReason::NONE;
+    while (r0 == StopReason::NONE) r0 = s0.steps(1000);
+    while (r1 == StopReason::NONE) r1 = s1.steps(100);
+    assert(r0 == StopReason::OPTIMAL && r1 == StopReason::OPTIMAL);
+    assert(s1.is_optimal());
+    assert(s0.get_solution(0).output == s1.get_best_solution().output);
+    assert(std::get<0>(s1.current_bounds()) == std::get<0>(s0.current_bounds()));
+
+    // parts stopped by a stop condition report it, not NO_MORE_OPEN
+    PartitionedSearch<MaxOutputHeuristic> s2(wide_ensemble(60, 3, 3), 4, 2);
+    for (size_t i = 0; i < s2.num_parts(); ++i)
+        s2.part(i).stop_when_num_solutions_exceeds = 1;
+    StopReason r2 = StopReason::NONE;
+    while (r2 == StopReason::NONE) r2 = s2.steps(100);
+    assert(r2 == StopReason::NUM_SOLUTIONS_EXCEEDED);
+}
+
+void test_portfolio1()
+{
+    AddTree at = wide_ensemble(30, 3, 11);
+
+    Search<MaxOutputHeuristic> s0(at);
+    StopReason r0 = StopReason::NONE;
+    while (r0 == StopReason::NONE) r0 = s0.steps(1000);
+
+    auto configs = PortfolioSearch<MaxOutputHeuristic>::default_configs();
+    PortfolioSearch<MaxOutputHeuristic> s1(at, configs);
+    assert(s1.num_configs() == configs.size());
+    assert(s1.search(0).prepared() == s1.search(1).prepared()); // both AS_IS
+    assert(s1.search(0).prepared() != s1.search(2).prepared());
+    StopReason r1 = StopReason::NONE;
+    while (r1 == StopReason::NONE) r1 = s1.step_for(10.0, 100);
+    assert(r0 == StopReason::OPTIMAL && r1 == StopReason::OPTIMAL);
+    assert(s1.is_optimal());
+    assert(s1.best_config() != -1);
+    assert(s0.get_solution(0).output == s1.get_best_solution().output);
+
+    // the incumbent of one configuration prunes the others
+    bool shared = false;
+    for (size_t i = 0; i < s1.num_configs(); ++i)
+        shared |= s1.search(i).stop_when_upper_less_than > -FLOATT_INF;
+    assert(shared);
+
+    // every tree order keeps the base score
+    at.base_score = -100.0;
+    Search<MaxOutputHeuristic> s2(at);
+    StopReason r2 = StopReason::NONE;
+    while (r2 == StopReason::NONE) r2 = s2.steps(1000);
+    for (TreeOrder order : {TreeOrder::AS_IS, TreeOrder::REVERSED,
+            TreeOrder::LEAF_VALUE_VARIANCE})
+    {
+        PortfolioConfig config;
+        config.tree_order = order;
+        PortfolioSearch<MaxOutputHeuristic> s3(at, {config});
+        StopReason r3 = StopReason::NONE;
+        while (r3 == StopReason::NONE) r3 = s3.step_for(10.0, 100);
+        assert(r3 == StopReason::OPTIMAL);
+        assert(s2.get_solution(0).output == s3.get_best_solution().output);
+    }
+}
+
+void test_prepared1()
+{
+    AddTree at = wide_ensemble(30, 3, 11);
+    auto prep = PreparedEnsemble::create(at);
+    assert(prep->num_trees() == at.size());
+
+    Search<MaxOutputHeuristic> s0(at);
+    s0.eps = 0.9;
+    s0.auto_eps = false;
+    s0.steps(2000);
+
+    // concurrent searches on one prepared ensemble, same as s0
+    std::vector<std::unique_ptr<Search<MaxOutputHeuristic>>> ss;
+    for (int i = 0; i < 4; ++i)
+    {
+        ss.emplace_back(new Search<MaxOutputHeuristic>(prep));
+        ss.back()->eps = 0.9;
+        ss.back()->auto_eps = false;
+    }
+    ThreadPool pool(4);
+    pool.parallel_for(0, ss.size(), 1, [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; ++i)
+            ss[i]->steps(2000);
+    });
+    for (auto& s : ss)
+    {
+        assert(s->prepared() == prep);
+        assert(s->num_solutions() == s0.num_solutions());
+        assert(s->current_bounds() == s0.current_bounds());
+    }
+
+    // pruning does not touch the shared ensemble
+    Box box {{0, Domain(2.0, 5.0)}};
+    Search<MaxOutputHeuristic> s1(prep), s2(at);
+    s1.eps = s2.eps = 0.9;
+    s1.auto_eps = s2.auto_eps = false;
+    s1.prune_by_box(BoxRef(box));
+    s2.prune_by_box(BoxRef(box));
+    assert(s1.prepared() != prep);
+    s1.steps(1000);
+    s2.steps(1000);
+    assert(s1.current_bounds() == s2.current_bounds());
+    size_t num_invalid0 = 0, num_invalid1 = 0;
+    for (size_t t = 0; t < prep->num_trees(); ++t)
+    {
+        for (BoxRef b : prep->node_box(t))
+            num_invalid0 += b.is_invalid_box();
+        for (BoxRef b : s1.prepared()->node_box(t))
+            num_invalid1 += b.is_invalid_box();
+    }
+    assert(num_invalid0 == 0 && num_invalid1 > 0);
+
+    // restricting through the initial state keeps the prepared ensemble
+    Search<MaxOutputHeuristic> s3(prep);
+    s3.eps = 0.9;
+    s3.auto_eps = false;
+    s3.restrict_to_box(BoxRef(box));
+    assert(s3.prepared() == prep);
+    s3.steps(1000);
+    assert(s3.current_bounds() == s2.current_bounds());
+    assert(s3.num_solutions() == s2.num_solutions());
+}
+
+void test_robustness1()
+{
+    AddTree at = wide_ensemble(20, 3, 11);
+    size_t num_rows = 6, num_cols = 24;
+    std::mt19937 rng(3);
+    std::vector<FloatT> buf(num_rows * num_cols);
+    for (FloatT& v : buf)
+        v = static_cast<FloatT>(rng() % 100) / 10.0f;
+    data examples {buf.data(), num_rows, num_cols, num_cols, 1};
+
+    // target_at only: find examples for which `at` outputs more than zero
+    RobustnessSearch rob(AddTree(), at);
+    rob.start_delta = 0.5;
+    rob.num_threads = 4;
+    std::vector<double> max_times(num_rows, 5.0);
+    std::vector<RobustnessResult> res = rob.search(examples, max_times);
+    assert(res.size() == num_rows);
+
+    rob.num_threads = 1;
+    std::vector<RobustnessResult> res1 = rob.search(examples, max_times);
+
+    for (size_t i = 0; i < num_rows; ++i)
+    {
+        data row = examples.row(i);
+        const RobustnessResult& r = res[i];
+        assert(r.lower <= r.upper);
+        assert(r.lower == res1[i].lower && r.upper == res1[i].upper);
+        if (at.eval(row) < 0.0)
+            assert(r.lower > 0.0);
+        if (r.example.empty())
+            continue;
+        std::vector<FloatT> ex = r.example;
+        data adv {ex.data(), 1, num_cols, 0, 1};
+        assert(at.eval(adv) >= 0.0);
+        FloatT dist = 0.0;
+        for (size_t j = 0; j < num_cols; ++j)
+            dist = std::max(dist, std::abs(ex[j] - row[j]));
+        assert(dist <= r.upper);
+    }
+}
+
+void test_leaf_table1()
+{
+    AddTree at = wide_ensemble(10, 7, 5);
+    std::mt19937 rng(7);
+    std::vector<SimdIsa> isas {SimdIsa::SCALAR};
+    if (cpu_supports(SimdIsa::AVX2))
+        isas.push_back(SimdIsa::AVX2);
+
+    for (const Tree& t : at)
+    {
+        std::vector<BoxRef> node_box(t.num_nodes(), BoxRef::null_box());
+        std::vector<Box> boxes(t.num_nodes());
+        for (NodeId id = 1; id < static_cast<NodeId>(t.num_nodes()); ++id)
+        {
+            boxes[id] = t[id].compute_box();
+            node_box[id] = BoxRef(boxes[id]);
+        }
+        LeafBoxTable table(t, node_box);
+        assert(table.num_leafs() == t.num_leafs());
+
+        for (int i = 0; i < 50; ++i)
+        {
+            std::vector<Domain> flatbox(56);
+            for (int k = 0; k < 6; ++k)
+            {
+                FloatT a = rng() % 10, b = rng() % 10;
+                flatbox[rng() % 56] = {std::min(a, b), std::max(a, b)};
+            }
+
+            std::vector<NodeId> expected;
+            LeafIter it;
+            it.flatbox = flatbox;
+            it.setup_tree(t);
+            for (NodeId id; (id = it.next()) != -1; )
+                expected.push_back(id);
+
+            for (SimdIsa isa : isas)
+            {
+                std::vector<NodeId> ids;
+                table.set_simd_isa(isa);
+                assert(table.find_overlapping(flatbox, ids));
+                assert(ids == expected);
+            }
+        }
+    }
+}
+
 int main()
 {
     //test_tree1();
     //test_tree2();
     //test_tree3();
-    //test_json1();
-    //test_json2();
+    test_json1();
+    test_json2();
+    test_json3();
 
     //test_eval1();
     //test_eval2();
@@ -1047,5 +2114,25 @@ int main()
     //test_constraints1();
     
     //test_get_domain_from_box();
+    test_compiled1();
+    test_compiled_simd1();
+    test_quickscorer1();
+    test_relayout1();
+    test_native1();
+    test_binary1();
+    test_shm1();
+    test_cow1();
+    test_minmax1();
+    test_incremental1();
+    test_leaf_table1();
+    test_hda1();
+    test_partitioned1();
+    test_portfolio1();
+    test_prepared1();
+    test_robustness1();
+    test_xgb1();
+    test_lgb1();
+    test_from_arrays1();
+    //bench_eval1();
     test_search1();
 }
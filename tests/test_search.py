@@ -94,6 +94,97 @@ class TestSearch(unittest.TestCase):
         plot_img_solutions(imghat, solutions[:3])
         plot_img_solutions(imghat, solutions[-3:])
 
+    def test_partitioned(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+
+        search = Search.max_output(at)
+        done = StopReason.NONE
+        while done == StopReason.NONE:
+            done = search.steps(100)
+        self.assertEqual(done, StopReason.OPTIMAL)
+
+        psearch = PartitionedSearch(at, 4, 2)
+        self.assertEqual(psearch.num_parts(), 4)
+        done = StopReason.NONE
+        while done == StopReason.NONE:
+            done = psearch.steps(100)
+        self.assertEqual(done, StopReason.OPTIMAL)
+        self.assertTrue(psearch.is_optimal())
+        self.assertEqual(psearch.get_best_solution().output, search.get_solution(0).output)
+
+    def test_portfolio(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+
+        search = Search.max_output(at)
+        done = StopReason.NONE
+        while done == StopReason.NONE:
+            done = search.steps(100)
+
+        portfolio = PortfolioSearch(at)
+        self.assertEqual(portfolio.num_configs(), len(PortfolioSearch.default_configs()))
+        done = StopReason.NONE
+        while done == StopReason.NONE:
+            done = portfolio.step_for(1.0, 100)
+        self.assertEqual(done, StopReason.OPTIMAL)
+        self.assertEqual(portfolio.get_best_solution().output, search.get_solution(0).output)
+
+    def test_portfolio_base_score(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        at.base_score = -100.0
+
+        search = Search.max_output(at)
+        done = StopReason.NONE
+        while done == StopReason.NONE:
+            done = search.steps(100)
+
+        for order in [TreeOrder.AS_IS, TreeOrder.REVERSED, TreeOrder.LEAF_VALUE_VARIANCE]:
+            config = PortfolioConfig()
+            config.tree_order = order
+            portfolio = PortfolioSearch(at, [config])
+            done = StopReason.NONE
+            while done == StopReason.NONE:
+                done = portfolio.step_for(1.0, 100)
+            self.assertEqual(done, StopReason.OPTIMAL)
+            self.assertEqual(portfolio.get_best_solution().output, search.get_solution(0).output)
+
+    def test_prepared(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        prep = PreparedEnsemble(at)
+        self.assertEqual(prep.num_trees(), len(at))
+
+        outputs = []
+        for s in [Search.max_output(at), Search.max_output(prep), Search.max_output(prep)]:
+            done = StopReason.NONE
+            while done == StopReason.NONE:
+                done = s.steps(100)
+            outputs.append(s.get_solution(0).output)
+        self.assertEqual(outputs[0], outputs[1])
+        self.assertEqual(outputs[0], outputs[2])
+
+    def test_batch_robustness(self):
+        img = np.load(os.path.join(BPATH, "data/img.npy"))
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        at.base_score -= np.median(img)
+        X = np.array([[x, y] for x in range(0, 100, 20) for y in range(0, 100, 20)],
+                dtype=np.float32)
+        yhat = at.eval(X)
+
+        rob = BatchRobustnessSearch(None, at)
+        rob.start_delta = 5.0
+        delta, lower, upper, examples = rob.search(X, 1.0)
+        self.assertEqual(examples.shape, X.shape)
+        self.assertTrue(np.all(lower <= upper))
+        for i in range(X.shape[0]):
+            if yhat[i] < 0.0:
+                self.assertGreater(lower[i], 0.0)
+            if not np.isnan(examples[i, 0]):
+                self.assertGreaterEqual(at.eval(examples[i])[0], 0.0)
+                self.assertLessEqual(np.max(np.abs(examples[i] - X[i])), upper[i])
+
+        # float64 input is converted
+        delta, lower, upper, examples = rob.search(X.astype(np.float64), 1.0)
+        self.assertEqual(examples.shape, X.shape)
+
     def test_img2(self):
         img = np.load(os.path.join(BPATH, "data/img.npy"))
         X = np.array([[x, y] for x in range(100) for y in range(100)])
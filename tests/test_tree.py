@@ -1,7 +1,9 @@
-import unittest, pickle, math
+import unittest, pickle, math, os, tempfile
 import numpy as np
 from veritas import *
 
+BPATH = os.path.dirname(__file__)
+
 class TestTree(unittest.TestCase):
 
     def myAssertAlmostEqual(self, a, b, eps=1e-6):
@@ -136,5 +138,233 @@ class TestTree(unittest.TestCase):
         att = pickle.loads(pickle.dumps(at))
         self.assertEqual(at.num_nodes(), att.num_nodes())
 
+    def test_compiled1(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        cat = at.compile()
+        X = np.random.uniform(0, 100, size=(1000, 2)).astype(np.float32)
+
+        self.assertEqual(len(cat), len(at))
+        self.assertEqual(cat.num_nodes(), at.num_nodes())
+        self.assertTrue(np.all(cat.eval(X) == at.eval(X)))
+        self.assertTrue(np.all(cat.eval_node(X, 3) == at[3].eval_node(X)))
+
+    def test_compiled_simd(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-hard.json"))
+        cat = at.compile()
+        X = np.random.uniform(0, 100, size=(1001, 2)).astype(np.float32)
+        y = np.array([at.eval(x)[0] for x in X]) # scalar path, one row at a time
+        for isa in [SimdIsa.SCALAR, SimdIsa.AVX2, SimdIsa.AVX512]:
+            if not cpu_supports(isa): continue
+            cat.simd_isa = isa
+            self.assertTrue(np.all(cat.eval(X) == y))
+
+    def test_eval_batch(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        X = np.random.uniform(0, 100, size=(1000, 2)).astype(np.float32)
+        y = at.eval(X)
+        self.assertTrue(np.all(at.eval_batch(X, num_threads=4) == y))
+        self.assertTrue(np.all(at.eval_batch(np.asfortranarray(X), num_threads=3) == y))
+        self.assertTrue(np.all(at.compile().eval(X[::2], num_threads=2) == y[::2]))
+
+    def test_quickscorer(self):
+        for f in ["xgb-img-easy.json", "xgb-img-hard.json"]:
+            at = AddTree.read(os.path.join(BPATH, "models", f))
+            qs = QuickScorer(at)
+            self.assertEqual(len(qs), len(at))
+            X = np.random.uniform(0, 100, size=(500, 2)).astype(np.float32)
+            X[::17, 0] = np.nan
+            y = np.array([at.eval(x)[0] for x in X])
+            self.assertTrue(np.all(qs.eval(X) == y))
+
+    def test_relayout(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-hard.json"))
+        X = np.random.uniform(0, 100, size=(200, 2)).astype(np.float32)
+        y = at.eval(X)
+        for layout in [NodeLayout.BFS, NodeLayout.DFS_HOT, NodeLayout.VEB]:
+            at2 = at.copy()
+            maps = at2.relayout(layout, X)
+            self.assertEqual(at2.to_json(), at.to_json())
+            self.assertTrue(np.all(at2.eval(X) == y))
+            for t in range(len(at)):
+                nids = at[t].eval_node(X)
+                self.assertTrue(np.all(np.array(maps[t])[nids] == at2[t].eval_node(X)))
+
+        t = at.copy()[0]
+        counts = t.compute_visit_counts(X)
+        self.assertEqual(counts[t.root()], 200)
+        t.relayout(NodeLayout.DFS_HOT, counts)
+
+    def test_native(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        X = np.random.uniform(0, 100, size=(300, 2)).astype(np.float32)
+        with tempfile.TemporaryDirectory() as d:
+            so_path = os.path.join(d, "model.so")
+            np_ = at.compile_native(so_path)
+            self.assertEqual(len(np_), len(at))
+            self.assertTrue(np_.is_bit_exact(at, X))
+            self.assertTrue(np.all(np_.eval(X) == at.eval(X)))
+            self.assertTrue(np.all(NativePredictor(so_path).eval(X) == at.eval(X)))
+
+    def test_binary(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-hard.json"))
+        X = np.random.uniform(0, 100, size=(100, 2)).astype(np.float32)
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, "model.bin")
+            at.to_binary(path)
+            at2 = AddTree.from_binary(path)
+            at3 = AddTree.map_binary(path)
+            self.assertFalse(at2[0].is_view())
+            self.assertTrue(at3[0].is_view())
+            for a in [at2, at3]:
+                self.assertEqual(a.to_json(), at.to_json())
+                self.assertTrue(np.all(a.eval(X) == at.eval(X)))
+            at3[0].set_leaf_value(at3[0].get_leaf_ids()[0], 5.0)
+            self.assertFalse(at3[0].is_view())
+            del at3 # unmap while the file still exists
+
+        at4 = pickle.loads(pickle.dumps(at))
+        self.assertEqual(at4.to_json(), at.to_json())
+
+    def test_json_stream(self):
+        at = AddTree()
+        at.base_score = 0.1
+        t = at.add_tree()
+        t.split(t.root(), 0, np.nextafter(np.float32(12.3), np.float32(13.0)))
+        t.set_leaf_value(t.left(t.root()), 1e-30)
+        t.set_leaf_value(t.right(t.root()), -123456.789)
+        with tempfile.TemporaryDirectory() as d:
+            for compress in [False, True]:
+                path = os.path.join(d, "model.json")
+                at.write(path, compress=compress)
+                at2 = AddTree.read(path, compressed=compress)
+                self.assertEqual(at2.to_json(), at.to_json())
+                self.assertEqual(at2.base_score, at.base_score)
+                self.assertEqual(at2[0].get_split(0), at[0].get_split(0))
+
+    def test_xgb_file(self):
+        ats = addtrees_from_xgb_file(os.path.join(BPATH, "models/xgb-multiclass.json"))
+        self.assertEqual(len(ats), 3)
+        self.assertTrue(all(len(at) == 2 and at.base_score == 0.5 for at in ats))
+
+        at_json, = addtrees_from_xgb_file(os.path.join(BPATH, "models/xgb-binary.json"))
+        at_ubj, = addtrees_from_xgb_file(os.path.join(BPATH, "models/xgb-binary.ubj"))
+        self.assertEqual(at_json.to_json(), at_ubj.to_json())
+        self.assertAlmostEqual(at_json.base_score, math.log(0.25), places=5)
+
+        # UTF-8 feature names and attributes
+        at_utf8, = addtrees_from_xgb_file(os.path.join(BPATH, "models/xgb-binary-utf8.json"))
+        self.assertEqual(at_utf8.to_json(), at_json.to_json())
+
+    def test_lgb_file(self):
+        path = os.path.join(BPATH, "models/lgb-multiclass.txt")
+        ats = addtrees_from_lgb_file(path)
+        self.assertEqual(len(ats), 3)
+        self.assertTrue(all(len(at) == 2 for at in ats))
+        with open(path) as f:
+            ats2 = addtrees_from_lgb_string(f.read())
+        self.assertEqual([at.to_json() for at in ats], [at.to_json() for at in ats2])
+
+        # x <= 2.5 goes left
+        x = np.array([[2.5, 0.0, 0.0], [np.nextafter(np.float32(2.5), np.float32(3.0)), 0.0, 0.0]],
+                dtype=np.float32)
+        self.assertEqual(ats[0][0].eval(x)[0], -1.25)
+        self.assertEqual(ats[0][0].eval(x)[1], 0.5)
+
+    def test_add_tree_from_arrays(self):
+        # scikit-learn `tree_` layout
+        left = np.array([1, 2, -1, -1, -1])
+        right = np.array([4, 3, -1, -1, -1])
+        feature = np.array([0, 1, -2, -2, -2])
+        threshold = np.array([2.5, 0.30000000000000004, -2, -2, -2])
+        value = np.array([0.0, 0.0, 1.0, 2.0, 3.0])
+
+        at = AddTree()
+        t = at.add_tree_from_arrays(left, right, feature, threshold, value)
+        self.assertEqual(t.num_nodes(), 5)
+        self.assertEqual(t.get_split(t.root()),
+                LtSplit(0, np.nextafter(np.float32(2.5), np.float32(np.inf))))
+        at.add_trees_from_arrays([(left, right, feature, threshold, value)] * 10)
+        self.assertEqual(len(at), 11)
+
+        x = np.array([[2.5, 0.3, 0.0], [2.5, 0.29999998, 0.0], [2.6, 0.0, 0.0]], dtype=np.float32)
+        self.assertEqual(list(at.eval(x)), [22.0, 11.0, 33.0])
+
+    def test_node_arrays(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        t = at[1]
+        a = t.node_arrays()
+        self.assertEqual(len(a["feat_id"]), t.num_nodes())
+        self.assertFalse(a["value"].flags.writeable)
+        self.assertEqual(a["parent"][0], 0) # the root is its own parent
+        for n in range(t.num_nodes()):
+            if n > 0:
+                self.assertEqual(a["parent"][n], t.parent(n))
+            if t.is_leaf(n):
+                self.assertEqual(a["feat_id"][n], -1)
+                self.assertEqual(a["value"][n], t.get_leaf_value(n))
+            else:
+                self.assertEqual(LtSplit(a["feat_id"][n], a["value"][n]), t.get_split(n))
+                self.assertEqual(a["left"][n], t.left(n))
+
+        b = at.node_arrays()
+        offsets = b["tree_offset"]
+        self.assertEqual(len(offsets), len(at) + 1)
+        self.assertEqual(offsets[-1], at.num_nodes())
+        for k in ["feat_id", "value", "left", "parent"]:
+            self.assertTrue(np.all(b[k][offsets[1]:offsets[2]] == a[k]))
+
+        # the views do not change when the tree is modified
+        num_nodes = t.num_nodes()
+        feat_id = a["feat_id"].copy()
+        leaf = t.get_leaf_ids()[0]
+        t.split(leaf, 0, 50.0)
+        t.set_leaf_value(t.left(leaf), 1000.0)
+        self.assertEqual(t.num_nodes(), num_nodes + 2)
+        self.assertEqual(len(a["feat_id"]), num_nodes)
+        self.assertTrue(np.all(a["feat_id"] == feat_id))
+
+        del at, t # the views keep the node storage alive
+        self.assertEqual(len(a["left"]), len(b["left"][offsets[1]:offsets[2]]))
+
+    def test_shared_memory(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        X = np.random.uniform(0, 100, size=(100, 2)).astype(np.float32)
+        with SharedAddTree(at) as shared:
+            self.assertTrue(shared.at[0].is_view())
+            self.assertTrue(np.all(shared.at.eval(X) == at.eval(X)))
+            other = pickle.loads(pickle.dumps(shared)) # attaches by name
+            self.assertFalse(other._owner)
+            self.assertEqual(other.at.to_json(), at.to_json())
+            s = Search.max_output(other.at)
+            s.steps(100)
+        with self.assertRaises(RuntimeError):
+            AddTree.attach_shared_memory(shared.name)
+
+    def test_copy_on_write(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        at2 = at.copy()
+        self.assertTrue(at2[0].is_shared())
+        at2[0].set_leaf_value(at2[0].get_leaf_ids()[0], 1000.0)
+        self.assertFalse(at2[0].is_shared())
+        self.assertNotEqual(at.to_json(), at2.to_json())
+
+        neg = at.negate_leaf_values()
+        self.assertTrue(neg[0].has_leaf_transform())
+        X = np.random.uniform(0, 100, size=(100, 2)).astype(np.float32)
+        self.assertTrue(np.all(neg.eval(X) == -at.eval(X)))
+        leaf = at[0].get_leaf_ids()[0]
+        self.assertEqual(neg[0].node_arrays()["value"][leaf], -at[0].get_leaf_value(leaf))
+
+    def test_minmax_cache(self):
+        at = AddTree.read(os.path.join(BPATH, "models/xgb-img-easy.json"))
+        t = at[0]
+        expected = [t.find_minmax_leaf_value(i) for i in range(t.num_nodes())]
+        t.cache_minmax()
+        self.assertTrue(t.has_minmax_cache())
+        self.assertEqual([t.find_minmax_leaf_value(i) for i in range(t.num_nodes())], expected)
+        t.set_leaf_value(t.get_leaf_ids()[0], 1000.0)
+        self.assertFalse(t.has_minmax_cache())
+        self.assertEqual(t.find_minmax_leaf_value(t.root())[1], 1000.0)
+
 if __name__ == "__main__":
     unittest.main()